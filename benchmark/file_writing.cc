@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "buffered_writer.h"
+
+// Benchmark of writing a log to a file, flushed every kLinesPerFlush lines,
+// with the BufferedWriter protocol, std::ofstream, and one write() per line.
+
+constexpr std::size_t kNumLines = 1 << 20;
+constexpr std::size_t kLinesPerFlush = 256;
+
+std::vector<std::string> MakeLines() {
+  std::vector<std::string> lines;
+  lines.reserve(kNumLines);
+  for (std::size_t i = 0; i < kNumLines; ++i) {
+    lines.push_back("2019-06-01 12:00:00 INFO request " + std::to_string(i) +
+                    " done\n");
+  }
+  return lines;
+}
+
+bool WriteProtEnc(const char* path, const std::vector<std::string>& lines) {
+  auto writer = GetBufferedWriter().open(path);
+  for (std::size_t i = 0; i < kNumLines; i += kLinesPerFlush) {
+    auto dirty = std::move(writer).append(lines[i]);
+    for (std::size_t j = i + 1; j < i + kLinesPerFlush; ++j) {
+      dirty = std::move(dirty).append(lines[j]);
+    }
+    writer = std::move(dirty).flush();
+  }
+  return std::move(writer).close() == 0;
+}
+
+bool WriteOfstream(const char* path, const std::vector<std::string>& lines) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  for (std::size_t i = 0; i < kNumLines; ++i) {
+    file << lines[i];
+    if ((i + 1) % kLinesPerFlush == 0) file.flush();
+  }
+  file.close();
+  return !file.fail();
+}
+
+bool WriteRaw(const char* path, const std::vector<std::string>& lines) {
+  std::FILE* file = std::fopen(path, "w");
+  if (file == nullptr) return false;
+  const int fd = fileno(file);
+  bool ok = true;
+  for (const std::string& line : lines) {
+    ok &= write(fd, line.data(), line.size()) ==
+          static_cast<ssize_t>(line.size());
+  }
+  return std::fclose(file) == 0 && ok;
+}
+
+int main() {
+  char path[] = "/tmp/protenc_file_writing_XXXXXX";
+  const int fd = mkstemp(path);
+  if (fd < 0) {
+    std::printf("Could not create a temporary file\n");
+    return 1;
+  }
+  close(fd);
+  const std::vector<std::string> lines = MakeLines();
+  std::size_t num_bytes = 0;
+  for (const std::string& line : lines) num_bytes += line.size();
+
+  struct Implementation {
+    const char* name;
+    bool (*write)(const char*, const std::vector<std::string>&);
+  };
+  const Implementation implementations[] = {
+      {"BufferedWriter", &WriteProtEnc},
+      {"std::ofstream", &WriteOfstream},
+      {"write per line", &WriteRaw},
+  };
+  std::printf("Writing %zu lines (%zu MB), flushed every %zu lines:\n",
+              kNumLines, num_bytes >> 20, kLinesPerFlush);
+  for (const Implementation& implementation : implementations) {
+    const auto start = std::chrono::steady_clock::now();
+    const bool ok = implementation.write(path, lines);
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (!ok) {
+      std::printf("%s failed\n", implementation.name);
+      unlink(path);
+      return 1;
+    }
+    std::printf("%-15s %8.1f MB/s %8.2f M lines/s\n", implementation.name,
+                num_bytes / elapsed.count() / 1e6,
+                kNumLines / elapsed.count() / 1e6);
+  }
+  unlink(path);
+  return 0;
+}
@@ -0,0 +1,105 @@
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "protenc_names.h"
+
+// Benchmark of the StaticNameMap perfect hash against a chain of string
+// comparisons (what a "switch" on strings compiles to), for 10 to 1000 names.
+
+// Generated names "state_0", "state_1", ...: the characters, then the views.
+template <std::size_t N>
+constexpr auto name_chars = [] {
+  std::array<char, N * 12> chars{};
+  std::size_t position = 0;
+  for (std::size_t i = 0; i < N; ++i) {
+    for (char c : std::string_view("state_")) chars[position++] = c;
+    char digits[8] = {};
+    std::size_t num_digits = 0;
+    std::size_t value = i;
+    do {
+      digits[num_digits++] = static_cast<char>('0' + value % 10);
+      value /= 10;
+    } while (value != 0);
+    while (num_digits > 0) chars[position++] = digits[--num_digits];
+    chars[position++] = '\0';
+  }
+  return chars;
+}();
+
+template <std::size_t N>
+constexpr auto names = [] {
+  std::array<std::string_view, N> result{};
+  const char* begin = name_chars<N>.data();
+  for (std::size_t i = 0; i < N; ++i) {
+    std::size_t size = 0;
+    while (begin[size] != '\0') ++size;
+    result[i] = std::string_view(begin, size);
+    begin += size + 1;
+  }
+  return result;
+}();
+
+template <std::size_t N>
+constexpr prot_enc::StaticNameMap<N> name_map = [] {
+  constexpr prot_enc::StaticNameMap<N> map{names<N>};
+  static_assert(map.built());
+  return map;
+}();
+
+template <std::size_t N>
+std::size_t FindWithChain(std::string_view name) {
+  for (std::size_t i = 0; i < N; ++i) {
+    if (name == names<N>[i]) return i;
+  }
+  return N;
+}
+
+template <typename Function>
+double NanosecondsPerLookup(const std::vector<std::string>& keys,
+                            Function find, std::size_t& checksum) {
+  constexpr int kRounds = 20;
+  const auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < kRounds; ++round) {
+    for (const std::string& key : keys) checksum += find(key);
+  }
+  const std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / (kRounds * keys.size());
+}
+
+template <std::size_t N>
+void Benchmark() {
+  // 90% of existing names, 10% of unknown ones, in random order.
+  std::mt19937 random(42);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 100000; ++i) {
+    if (i % 10 == 0) {
+      keys.push_back("unknown_" + std::to_string(random() % N));
+    } else {
+      keys.emplace_back(names<N>[random() % N]);
+    }
+  }
+  std::size_t checksum = 0;
+  const double hash = NanosecondsPerLookup(
+      keys, [](std::string_view key) { return name_map<N>.find(key); },
+      checksum);
+  const double chain = NanosecondsPerLookup(keys, &FindWithChain<N>, checksum);
+  std::printf("%5zu names: perfect hash %6.2f ns, comparison chain %8.2f ns"
+              " (checksum %zu)\n",
+              N, hash, chain, checksum);
+}
+
+int main() {
+  Benchmark<10>();
+  Benchmark<30>();
+  Benchmark<100>();
+  Benchmark<300>();
+  Benchmark<1000>();
+  return 0;
+}
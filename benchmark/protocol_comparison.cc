@@ -0,0 +1,334 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "http_connection.h"
+
+// Benchmark of the HTTP connection builder protocol of
+// example/http_connection.h, implemented four ways:
+//   - ProtEnc: the protocol is checked at compile time.
+//   - std::variant: one alternative per state, holding the data of the state.
+//   - Virtual State pattern: the builder delegates to a state object.
+//   - enum + switch: the builder checks its state in every method.
+// The three runtime implementations throw on an invalid call. For each, it
+// reports the throughput of building connections with 1 to 64 headers, the
+// size of the code building one connection, and the size of the builder.
+
+// Each implementation's code goes in its own section, whose size the linker
+// gives us (GNU linkers on ELF platforms).
+#if defined(__GNUC__) && defined(__ELF__)
+#define BENCHMARK_CODE(NAME) [[gnu::noinline, gnu::section("bench_" #NAME)]]
+#define DECLARE_CODE_SIZE(NAME)                           \
+  extern "C" const char __start_bench_##NAME[];           \
+  extern "C" const char __stop_bench_##NAME[];            \
+  std::size_t CodeSize_##NAME() {                         \
+    return __stop_bench_##NAME - __start_bench_##NAME;    \
+  }
+#else
+#define BENCHMARK_CODE(NAME) [[gnu::noinline]]
+#define DECLARE_CODE_SIZE(NAME) \
+  std::size_t CodeSize_##NAME() { return 0; }
+#endif
+
+// Short headers, so that the strings don't allocate.
+const char kHeader[] = "Accept: */*";
+const char kBody[] = "Hello";
+
+
+/******************************************************************************
+ *  PROTENC                                                                   *
+ ******************************************************************************/
+
+BENCHMARK_CODE(protenc)
+HTTPConnection BuildProtEnc(std::size_t num_headers) {
+  auto builder = GetConnectionBuilder().add_header(kHeader);
+  for (std::size_t i = 1; i < num_headers; ++i) {
+    builder = std::move(builder).add_header(kHeader);
+  }
+  return std::move(builder).add_body(kBody).build();
+}
+
+DECLARE_CODE_SIZE(protenc)
+
+
+/******************************************************************************
+ *  STD::VARIANT                                                              *
+ ******************************************************************************/
+
+namespace variant_builder {
+
+struct Start {};
+struct Headers {
+  std::vector<std::string> headers;
+};
+struct Body {
+  std::vector<std::string> headers;
+  std::string body;
+};
+
+class Builder {
+ public:
+  void add_header(std::string header) {
+    if (std::holds_alternative<Start>(state_)) state_.emplace<Headers>();
+    Headers* headers = std::get_if<Headers>(&state_);
+    if (headers == nullptr) throw std::logic_error("add_header: wrong state");
+    headers->headers.push_back(std::move(header));
+  }
+
+  void add_body(std::string body) {
+    Headers* headers = std::get_if<Headers>(&state_);
+    if (headers == nullptr) throw std::logic_error("add_body: wrong state");
+    state_ = Body{std::move(headers->headers), std::move(body)};
+  }
+
+  HTTPConnection build() && {
+    Body* body = std::get_if<Body>(&state_);
+    if (body == nullptr) throw std::logic_error("build: wrong state");
+    return HTTPConnection(std::move(body->headers), std::move(body->body));
+  }
+
+ private:
+  std::variant<Start, Headers, Body> state_;
+};
+
+} // namespace variant_builder
+
+BENCHMARK_CODE(variant)
+HTTPConnection BuildVariant(std::size_t num_headers) {
+  variant_builder::Builder builder;
+  for (std::size_t i = 0; i < num_headers; ++i) builder.add_header(kHeader);
+  builder.add_body(kBody);
+  return std::move(builder).build();
+}
+
+DECLARE_CODE_SIZE(variant)
+
+
+/******************************************************************************
+ *  VIRTUAL STATE PATTERN                                                     *
+ ******************************************************************************/
+
+namespace virtual_builder {
+
+class Builder;
+
+// The states have no data: there is one instance of each.
+class State {
+ public:
+  virtual ~State() = default;
+  virtual void add_header(Builder& builder, std::string header) const;
+  virtual void add_body(Builder& builder, std::string body) const;
+  virtual HTTPConnection build(Builder& builder) const;
+};
+
+class StartState : public State {
+ public:
+  void add_header(Builder& builder, std::string header) const override;
+};
+
+class HeadersState : public State {
+ public:
+  void add_header(Builder& builder, std::string header) const override;
+  void add_body(Builder& builder, std::string body) const override;
+};
+
+class BodyState : public State {
+ public:
+  HTTPConnection build(Builder& builder) const override;
+};
+
+const StartState kStart;
+const HeadersState kHeaders;
+const BodyState kBody;
+
+class Builder {
+ public:
+  void add_header(std::string header) {
+    state_->add_header(*this, std::move(header));
+  }
+  void add_body(std::string body) { state_->add_body(*this, std::move(body)); }
+  HTTPConnection build() && { return state_->build(*this); }
+
+ private:
+  friend class StartState;
+  friend class HeadersState;
+  friend class BodyState;
+
+  const State* state_ = &kStart;
+  std::vector<std::string> headers_;
+  std::string body_;
+};
+
+BENCHMARK_CODE(virtual)
+void State::add_header(Builder&, std::string) const {
+  throw std::logic_error("add_header: wrong state");
+}
+
+BENCHMARK_CODE(virtual)
+void State::add_body(Builder&, std::string) const {
+  throw std::logic_error("add_body: wrong state");
+}
+
+BENCHMARK_CODE(virtual)
+HTTPConnection State::build(Builder&) const {
+  throw std::logic_error("build: wrong state");
+}
+
+BENCHMARK_CODE(virtual)
+void StartState::add_header(Builder& builder, std::string header) const {
+  builder.headers_.push_back(std::move(header));
+  builder.state_ = &kHeaders;
+}
+
+BENCHMARK_CODE(virtual)
+void HeadersState::add_header(Builder& builder, std::string header) const {
+  builder.headers_.push_back(std::move(header));
+}
+
+BENCHMARK_CODE(virtual)
+void HeadersState::add_body(Builder& builder, std::string body) const {
+  builder.body_ = std::move(body);
+  builder.state_ = &kBody;
+}
+
+BENCHMARK_CODE(virtual)
+HTTPConnection BodyState::build(Builder& builder) const {
+  return HTTPConnection(std::move(builder.headers_), std::move(builder.body_));
+}
+
+} // namespace virtual_builder
+
+BENCHMARK_CODE(virtual)
+HTTPConnection BuildVirtual(std::size_t num_headers) {
+  virtual_builder::Builder builder;
+  for (std::size_t i = 0; i < num_headers; ++i) builder.add_header(kHeader);
+  builder.add_body(kBody);
+  return std::move(builder).build();
+}
+
+DECLARE_CODE_SIZE(virtual)
+
+
+/******************************************************************************
+ *  ENUM + SWITCH                                                             *
+ ******************************************************************************/
+
+namespace switch_builder {
+
+class Builder {
+ public:
+  void add_header(std::string header) {
+    switch (state_) {
+      case HTTPBuilderState::START:
+      case HTTPBuilderState::HEADERS:
+        headers_.push_back(std::move(header));
+        state_ = HTTPBuilderState::HEADERS;
+        return;
+      default:
+        throw std::logic_error("add_header: wrong state");
+    }
+  }
+
+  void add_body(std::string body) {
+    switch (state_) {
+      case HTTPBuilderState::HEADERS:
+        body_ = std::move(body);
+        state_ = HTTPBuilderState::BODY;
+        return;
+      default:
+        throw std::logic_error("add_body: wrong state");
+    }
+  }
+
+  HTTPConnection build() && {
+    switch (state_) {
+      case HTTPBuilderState::BODY:
+        return HTTPConnection(std::move(headers_), std::move(body_));
+      default:
+        throw std::logic_error("build: wrong state");
+    }
+  }
+
+ private:
+  HTTPBuilderState state_ = HTTPBuilderState::START;
+  std::vector<std::string> headers_;
+  std::string body_;
+};
+
+} // namespace switch_builder
+
+BENCHMARK_CODE(switch)
+HTTPConnection BuildSwitch(std::size_t num_headers) {
+  switch_builder::Builder builder;
+  for (std::size_t i = 0; i < num_headers; ++i) builder.add_header(kHeader);
+  builder.add_body(kBody);
+  return std::move(builder).build();
+}
+
+DECLARE_CODE_SIZE(switch)
+
+
+/******************************************************************************
+ *  BENCHMARK                                                                 *
+ ******************************************************************************/
+
+// Millions of connections built per second.
+double MillionsPerSecond(HTTPConnection (*build)(std::size_t),
+                         std::size_t num_headers, std::size_t& checksum) {
+  // About the same number of headers for every chain length.
+  const std::size_t num_connections = 4000000 / (num_headers + 2);
+  const auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < num_connections; ++i) {
+    const HTTPConnection connection = build(num_headers);
+    checksum += std::get<0>(connection).size() + std::get<1>(connection).size();
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return num_connections / elapsed.count() / 1e6;
+}
+
+int main() {
+  struct Implementation {
+    const char* name;
+    HTTPConnection (*build)(std::size_t);
+    std::size_t code_size;
+    std::size_t object_size;
+  };
+  const Implementation implementations[] = {
+      {"ProtEnc", &BuildProtEnc, CodeSize_protenc(),
+       sizeof(HTTPConnectionBuilderWrapper<HTTPBuilderState::HEADERS>)},
+      {"std::variant", &BuildVariant, CodeSize_variant(),
+       sizeof(variant_builder::Builder)},
+      {"virtual State", &BuildVirtual, CodeSize_virtual(),
+       sizeof(virtual_builder::Builder)},
+      {"enum + switch", &BuildSwitch, CodeSize_switch(),
+       sizeof(switch_builder::Builder)},
+  };
+
+  std::printf("Millions of connections built per second, by number of "
+              "headers:\n%-14s", "");
+  const std::size_t chain_lengths[] = {1, 4, 16, 64};
+  for (std::size_t num_headers : chain_lengths) {
+    std::printf(" %8zu", num_headers);
+  }
+  std::printf("  code (bytes)  object (bytes)\n");
+
+  std::size_t checksum = 0;
+  for (const Implementation& implementation : implementations) {
+    std::printf("%-14s", implementation.name);
+    for (std::size_t num_headers : chain_lengths) {
+      std::printf(" %8.2f", MillionsPerSecond(implementation.build,
+                                              num_headers, checksum));
+    }
+    std::printf("  %12zu  %14zu\n", implementation.code_size,
+                implementation.object_size);
+  }
+  std::printf("(checksum %zu)\n", checksum);
+  return 0;
+}
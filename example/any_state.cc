@@ -0,0 +1,68 @@
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <variant>
+
+#include "http_connection.h"
+#include "protenc_any_state.h"
+
+// Example use of AnyState: HTTP connection builders whose state is only known
+// at runtime, stored in a hash map.
+
+using AnyBuilder =
+    prot_enc::AnyState<HTTPConnectionBuilderWrapper<HTTPBuilderState::START>>;
+
+// What AnyState replaces.
+using BuilderVariant =
+    std::variant<HTTPConnectionBuilderWrapper<HTTPBuilderState::START>,
+                 HTTPConnectionBuilderWrapper<HTTPBuilderState::HEADERS>,
+                 HTTPConnectionBuilderWrapper<HTTPBuilderState::BODY>>;
+
+int main() {
+    std::cout << "sizeof(AnyState): " << sizeof(AnyBuilder)
+              << ", sizeof(variant): " << sizeof(BuilderVariant) << '\n';
+
+    std::unordered_map<int, AnyBuilder> builders;
+    for (int id = 0; id < 10; ++id) {
+      builders.emplace(id, GetConnectionBuilder());
+    }
+
+    // Add headers to all of them, and a body to the even ones.
+    for (auto& [id, builder] : builders) {
+      builder.transition<&HTTPConnectionBuilder::add_header>("Host: a.com");
+      if (id % 2 == 0) {
+        builder.transition<&HTTPConnectionBuilder::add_body>("Body");
+      }
+    }
+
+    // A body can't be added twice: the transition is rejected.
+    bool added = builders.at(0).transition<&HTTPConnectionBuilder::add_body>(
+        "Second body");
+    std::cout << "Second body added: " << added << '\n';
+
+    // Build the ones that are ready.
+    int num_built = 0;
+    for (auto& [id, builder] : builders) {
+      if (auto ready = std::move(builder).try_as<HTTPBuilderState::BODY>()) {
+        HTTPConnection connection = std::move(*ready).build();
+        num_built += std::get<1>(connection) == "Body";
+      }
+    }
+    std::cout << "Built " << num_built << " connections\n";
+
+    // Visit the others, whatever their state: the visitor returns a wrapper
+    // in every state, so the result is an AnyState again.
+    for (auto& [id, builder] : builders) {
+      if (builder.empty()) continue;
+      builder = std::move(builder).visit([](auto wrapper) {
+        if constexpr (decltype(wrapper)::state == HTTPBuilderState::HEADERS) {
+          return std::move(wrapper).add_body("Late body");
+        } else {
+          return wrapper;
+        }
+      });
+      std::cout << id << " has a body: "
+                << builder.is<HTTPBuilderState::BODY>() << '\n';
+    }
+    return 0;
+}
@@ -0,0 +1,46 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "http_connection.h"
+#include "protenc_batch.h"
+
+// Example use of transition_batch: the same transition on many builders in
+// runtime states, validated 16 at a time and grouped by state.
+
+using AnyBuilder =
+    prot_enc::AnyState<HTTPConnectionBuilderWrapper<HTTPBuilderState::START>>;
+
+int main() {
+    std::vector<AnyBuilder> builders;
+    for (int i = 0; i < 100; ++i) {
+      if (i % 3 == 0) {
+        builders.emplace_back(GetConnectionBuilder());
+      } else if (i % 3 == 1) {
+        builders.emplace_back(GetConnectionBuilder().add_header("Header"));
+      } else {
+        builders.emplace_back(
+            GetConnectionBuilder().add_header("Header").add_body("Body"));
+      }
+    }
+
+    // add_header is valid in START and HEADERS: each of the two groups takes
+    // the transition of its state.
+    prot_enc::BatchPartition partition;
+    std::size_t num_headers =
+        prot_enc::transition_batch<&HTTPConnectionBuilder::add_header>(
+            std::span(builders), partition, std::string("Header"));
+    std::cout << "Added " << num_headers << " headers, "
+              << partition.invalid.size() << " builders rejected\n";
+
+    // add_body is only valid in HEADERS, where all the others now are.
+    std::size_t num_bodies =
+        prot_enc::transition_batch<&HTTPConnectionBuilder::add_body>(
+            std::span(builders), partition, std::string("Body"));
+    std::cout << "Added " << num_bodies << " bodies\n";
+    if (num_headers != 67 || num_bodies != 67) return 1;
+    for (const auto& builder : builders) {
+      if (!builder.is<HTTPBuilderState::BODY>()) return 1;
+    }
+    return 0;
+}
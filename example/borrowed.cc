@@ -0,0 +1,75 @@
+#include <array>
+#include <iostream>
+#include <string>
+
+#include "protenc.h"
+
+// Example use of a borrowing wrapper: the protocol is enforced on connections
+// that live in a fixed slab, owned by someone else. The wrappers only hold a
+// pointer to their connection.
+
+enum class ConnectionState { CLOSED, OPEN };
+
+class Connection {
+ public:
+  void open(std::string address) {
+    address_ = std::move(address);
+    num_messages_ = 0;
+  }
+
+  void send(const std::string& message) {
+    std::cout << "  " << address_ << " <- " << message << "\n";
+    ++num_messages_;
+  }
+
+  int close() && {
+    std::cout << "  closing " << address_ << "\n";
+    return num_messages_;
+  }
+
+ private:
+  std::string address_;
+  int num_messages_ = 0;
+};
+
+using prot_enc::FinalTransition;
+using prot_enc::Transition;
+
+using ConnectionInitialStates =
+    prot_enc::InitialStates<ConnectionState::CLOSED>;
+using ConnectionTransitions = prot_enc::Transitions<
+    Transition<ConnectionState::CLOSED, ConnectionState::OPEN,
+               &Connection::open>,
+    Transition<ConnectionState::OPEN, ConnectionState::OPEN,
+               &Connection::send>>;
+using ConnectionFinalTransitions = prot_enc::FinalTransitions<
+    FinalTransition<ConnectionState::OPEN, &Connection::close>>;
+using ConnectionValidQueries = prot_enc::ValidQueries<>;
+using BorrowedConnection = prot_enc::Borrowed<Connection>;
+
+PROTENC_START_WRAPPER(ConnectionWrapper, BorrowedConnection, ConnectionState,
+                      ConnectionInitialStates, ConnectionTransitions,
+                      ConnectionFinalTransitions, ConnectionValidQueries);
+  PROTENC_DECLARE_TRANSITION(open);
+  PROTENC_DECLARE_TRANSITION(send);
+  PROTENC_DECLARE_FINAL_TRANSITION(close);
+PROTENC_END_WRAPPER;
+
+// Moving the wrapper from one state to the next is moving a pointer.
+static_assert(sizeof(ConnectionWrapper<ConnectionState::OPEN>) ==
+              sizeof(Connection*));
+
+int main() {
+    // The slab of connections, owned outside of the wrappers.
+    std::array<Connection, 3> connections;
+    for (std::size_t i = 0; i < connections.size(); ++i) {
+      auto closed =
+          ConnectionWrapper<ConnectionState::CLOSED>::borrow(connections[i]);
+      auto open = std::move(closed).open("host-" + std::to_string(i));
+      // Does not compile: the connection is not open.
+      // std::move(closed).send("Hello");
+      int num_messages = std::move(open).send("Hello").send("Bye").close();
+      std::cout << "Sent " << num_messages << " messages\n";
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "buffered_writer.h"
+
+// Example use of the buffered writer: write a log in batches of lines.
+
+int main() {
+    char path[] = "/tmp/protenc_writer_XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd < 0) {
+      std::cerr << "Could not create a temporary file\n";
+      return 1;
+    }
+    close(fd);
+
+    auto writer = GetBufferedWriter().open(path);
+    for (int batch = 0; batch < 100; ++batch) {
+      auto dirty = std::move(writer).append("batch " + std::to_string(batch) +
+                                            "\n");
+      for (int line = 0; line < 1000; ++line) {
+        dirty = std::move(dirty).append("  line\n");
+      }
+      writer = std::move(dirty).flush();
+    }
+    // Does not compile: the data appended would not be written.
+    // std::move(writer).append("lost\n").close();
+    // Does not compile: there is nothing to flush.
+    // std::move(writer).flush();
+    const int error = std::move(writer).close();
+    if (error != 0) {
+      std::cerr << "Error: " << std::strerror(error) << "\n";
+      return 1;
+    }
+
+    std::ifstream file(path);
+    std::string line;
+    int num_lines = 0;
+    while (std::getline(file, line)) ++num_lines;
+    unlink(path);
+    std::cout << "Wrote " << num_lines << " lines\n";
+    return num_lines == 100 * 1001 ? 0 : 1;
+}
@@ -0,0 +1,172 @@
+#ifndef PROTENC_EXAMPLE_BUFFERED_WRITER_H_
+#define PROTENC_EXAMPLE_BUFFERED_WRITER_H_
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <utility>
+
+#include "protenc.h"
+
+// Example use of the ProtEnc library: a buffered file writer, e.g. for logs.
+//
+// The protocol is:
+//
+//  ********           *******             *******
+//  *CLOSED* --open--> *CLEAN* --append--> *DIRTY* --
+//  ********           *******             *******   |
+//                      |  ^                 |  ^    append
+//                      |  |                 |  |    |
+//                      |  ----flush----------  ------
+//                      |
+//                      -->close<--
+//
+// append() copies into the buffer, and only flush() writes it to the file.
+// The state says whether the buffer holds data: flush() is only possible with
+// data to write, and close() only with none, so neither checks a "dirty" flag,
+// and the data can't be forgotten in the buffer by a close(). The one runtime
+// check left is for a full buffer, which append() then writes out (an append
+// larger than the buffer is written directly).
+//
+// The errors of the syscalls don't change the state: they are recorded, the
+// next writes are skipped, and close() returns the errno of the first one.
+
+enum class WriterState {
+  CLOSED,
+  // Open, with an empty buffer.
+  CLEAN,
+  // Open, with data in the buffer.
+  DIRTY,
+};
+
+template <WriterState>
+class BufferedWriterWrapper;
+
+class BufferedWriter {
+ public:
+  static constexpr std::size_t kCapacity = 64 * 1024;
+
+  // Create or truncate the file.
+  void open(const char* path) {
+    fd_ = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0) fail();
+    buffer_ = std::make_unique_for_overwrite<char[]>(kCapacity);
+  }
+
+  void append(std::string_view text) {
+    if (text.size() > kCapacity - size_) [[unlikely]] return spill(text);
+    std::memcpy(buffer_.get() + size_, text.data(), text.size());
+    size_ += text.size();
+  }
+
+  void flush() {
+    write_all(buffer_.get(), size_);
+    size_ = 0;
+  }
+
+  // Close the file. Returns the errno of the first error, or 0.
+  int close() && {
+    if (fd_ >= 0 && ::close(fd_) != 0) fail();
+    fd_ = -1;
+    return error_;
+  }
+
+  // In case the protocol was not followed to the end: the buffer is lost.
+  ~BufferedWriter() {
+    if (fd_ >= 0) ::close(fd_);
+  }
+
+  BufferedWriter(BufferedWriter&& other)
+      : fd_(other.fd_),
+        buffer_(std::move(other.buffer_)),
+        size_(other.size_),
+        error_(other.error_) {
+    other.fd_ = -1;
+  }
+
+  // Swaps the objects: other closes the file of this object, losing its buffer
+  // like the destructor.
+  BufferedWriter& operator=(BufferedWriter&& other) {
+    std::swap(fd_, other.fd_);
+    std::swap(buffer_, other.buffer_);
+    std::swap(size_, other.size_);
+    std::swap(error_, other.error_);
+    return *this;
+  }
+
+ private:
+  BufferedWriter() = default;
+
+  template <WriterState>
+  friend class ::BufferedWriterWrapper;
+
+  void fail() {
+    if (error_ == 0) error_ = errno;
+  }
+
+  // The text doesn't fit in the buffer: write the buffer out first.
+  [[gnu::noinline]] void spill(std::string_view text) {
+    write_all(buffer_.get(), size_);
+    size_ = 0;
+    if (text.size() > kCapacity) return write_all(text.data(), text.size());
+    std::memcpy(buffer_.get(), text.data(), text.size());
+    size_ = text.size();
+  }
+
+  void write_all(const char* data, std::size_t size) {
+    while (size > 0 && error_ == 0) {
+      const ssize_t written = ::write(fd_, data, size);
+      if (written < 0) {
+        if (errno != EINTR) fail();
+        continue;
+      }
+      data += written;
+      size -= static_cast<std::size_t>(written);
+    }
+  }
+
+  int fd_ = -1;
+  std::unique_ptr<char[]> buffer_;
+  std::size_t size_ = 0;
+  int error_ = 0;
+};
+
+using WriterInitialStates = prot_enc::InitialStates<WriterState::CLOSED>;
+
+using WriterTransitions = prot_enc::Transitions<
+    prot_enc::Transition<WriterState::CLOSED, WriterState::CLEAN,
+                         &BufferedWriter::open>,
+    prot_enc::Transition<WriterState::CLEAN, WriterState::DIRTY,
+                         &BufferedWriter::append>,
+    prot_enc::Transition<WriterState::DIRTY, WriterState::DIRTY,
+                         &BufferedWriter::append>,
+    prot_enc::Transition<WriterState::DIRTY, WriterState::CLEAN,
+                         &BufferedWriter::flush>>;
+
+using WriterFinalTransitions = prot_enc::FinalTransitions<
+    prot_enc::FinalTransition<WriterState::CLEAN, &BufferedWriter::close>>;
+
+using WriterValidQueries = prot_enc::ValidQueries<>;
+
+PROTENC_START_WRAPPER(BufferedWriterWrapper, BufferedWriter, WriterState,
+                      WriterInitialStates, WriterTransitions,
+                      WriterFinalTransitions, WriterValidQueries);
+
+  PROTENC_DECLARE_TRANSITION(open);
+  PROTENC_DECLARE_TRANSITION(append);
+  PROTENC_DECLARE_TRANSITION(flush);
+
+  PROTENC_DECLARE_FINAL_TRANSITION(close);
+
+PROTENC_END_WRAPPER;
+
+inline BufferedWriterWrapper<WriterState::CLOSED> GetBufferedWriter() {
+  return {};
+}
+
+#endif // PROTENC_EXAMPLE_BUFFERED_WRITER_H_
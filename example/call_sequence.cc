@@ -0,0 +1,70 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "http_connection.h"
+#include "protenc_call_sequence.h"
+
+// Example use of the CallSequence: the calls on the HTTP connection builder
+// come from a configuration, only known at runtime. They are checked against
+// the protocol once, and the compiled sequence can then be run many times
+// without any check.
+
+using Sequence = prot_enc::CallSequence<
+    HTTPConnectionBuilderWrapper<HTTPBuilderState::START>>;
+using Protocol = Sequence::Protocol;
+
+// Parse a configuration of the form "method argument" per line.
+std::vector<Sequence::Step> ParseSteps(const std::string& configuration) {
+  std::vector<Sequence::Step> steps;
+  std::istringstream lines(configuration);
+  std::string method, argument;
+  while (lines >> method && std::getline(lines >> std::ws, argument)) {
+    if (method == "add_header") {
+      steps.emplace_back(
+          std::in_place_index<
+              Protocol::method_index<&HTTPConnectionBuilder::add_header>>,
+          argument);
+    } else if (method == "add_body") {
+      steps.emplace_back(
+          std::in_place_index<
+              Protocol::method_index<&HTTPConnectionBuilder::add_body>>,
+          argument);
+    }
+  }
+  return steps;
+}
+
+int main() {
+    std::optional<Sequence> sequence = Sequence::compile(
+        HTTPBuilderState::START,
+        ParseSteps("add_header Host: example.com\n"
+                   "add_header Accept: */*\n"
+                   "add_body Body\n"));
+    if (!sequence || sequence->end_state() != HTTPBuilderState::BODY) {
+      std::cout << "Invalid configuration\n";
+      return 1;
+    }
+    for (int i = 0; i < 3; ++i) {
+      auto builder =
+          sequence->run<HTTPBuilderState::BODY>(GetConnectionBuilder());
+      HTTPConnection connection = std::move(*builder).build();
+      std::cout << std::get<0>(connection).size() << " headers, body: "
+                << std::get<1>(connection) << '\n';
+    }
+
+    // The end state is only known at runtime: asking for another one fails.
+    auto headers =
+        sequence->run<HTTPBuilderState::HEADERS>(GetConnectionBuilder());
+    std::cout << "Run to HEADERS: " << headers.has_value() << '\n';
+
+    // This configuration is rejected when compiled: the body comes first.
+    std::size_t invalid_step;
+    std::optional<Sequence> invalid = Sequence::compile(
+        HTTPBuilderState::START,
+        ParseSteps("add_body Body\nadd_header Host: example.com\n"),
+        &invalid_step);
+    std::cout << "Invalid sequence rejected at step " << invalid_step << '\n';
+    return invalid.has_value() || headers.has_value();
+}
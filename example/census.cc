@@ -0,0 +1,120 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "protenc.h"
+#include "protenc_any_state.h"
+#include "protenc_census.h"
+#include "protenc_metrics.h"
+#include "protenc_names.h"
+#include "protenc_state_pool.h"
+
+// Example use of the CensusPolicy: requests created by a thread, some of them
+// completed by another thread, some stuck waiting for their body, and one
+// dropped. The requests stored in an AnyState or a StatePool are still
+// counted in their state.
+
+enum class RequestState { NEW, HEADERS, BODY };
+
+template <RequestState>
+class RequestWrapper;
+
+class Request {
+ public:
+  void headers(std::string headers) { headers_ = std::move(headers); }
+
+  void body(std::string body) { body_ = std::move(body); }
+
+  std::size_t respond() && { return headers_.size() + body_.size(); }
+
+ private:
+  Request() = default;
+
+  template <RequestState>
+  friend class ::RequestWrapper;
+
+  std::string headers_;
+  std::string body_;
+};
+
+using prot_enc::FinalTransition;
+using prot_enc::Transition;
+
+using RequestInitialStates = prot_enc::InitialStates<RequestState::NEW>;
+using RequestTransitions = prot_enc::Transitions<
+    Transition<RequestState::NEW, RequestState::HEADERS, &Request::headers>,
+    Transition<RequestState::HEADERS, RequestState::BODY, &Request::body>>;
+using RequestFinalTransitions = prot_enc::FinalTransitions<
+    FinalTransition<RequestState::BODY, &Request::respond>>;
+using RequestValidQueries = prot_enc::ValidQueries<>;
+
+PROTENC_START_WRAPPER_WITH_POLICY(RequestWrapper, Request, RequestState,
+                                  RequestInitialStates, RequestTransitions,
+                                  RequestFinalTransitions, RequestValidQueries,
+                                  prot_enc::CensusPolicy);
+  PROTENC_DECLARE_TRANSITION(headers);
+  PROTENC_DECLARE_TRANSITION(body);
+  PROTENC_DECLARE_FINAL_TRANSITION(respond);
+PROTENC_END_WRAPPER;
+
+using Census = prot_enc::ProtocolCensus<RequestWrapper<RequestState::NEW>>;
+using Names = prot_enc::ProtocolNames<RequestWrapper<RequestState::NEW>>;
+
+void PrintCensus() {
+  for (RequestState state : {RequestState::NEW, RequestState::HEADERS,
+                             RequestState::BODY}) {
+    std::cout << Names::state_name(state) << ": " << Census::live(state)
+              << " live, " << Census::abandoned(state) << " abandoned\n";
+  }
+}
+
+int main() {
+    std::vector<RequestWrapper<RequestState::HEADERS>> waiting;
+    std::vector<RequestWrapper<RequestState::BODY>> complete;
+    for (int i = 0; i < 10; ++i) {
+      auto request = RequestWrapper<RequestState::NEW>().headers("Host: a");
+      if (i % 3 == 0) {
+        waiting.push_back(std::move(request));
+      } else {
+        complete.push_back(std::move(request).body("Hello"));
+      }
+    }
+    // Not used yet.
+    RequestWrapper<RequestState::NEW> spare;
+    {
+      // Dropped without a response.
+      auto request = RequestWrapper<RequestState::NEW>().headers("");
+    }
+    PrintCensus();
+
+    // Responded to by another thread: the counts of both threads add up.
+    std::size_t sent = 0;
+    std::thread responder([&] {
+      for (auto& request : complete) sent += std::move(request).respond();
+    });
+    responder.join();
+    std::cout << "after the responses:\n";
+    PrintCensus();
+
+    // A late body, for a request whose state is only known at runtime.
+    prot_enc::AnyState<RequestWrapper<RequestState::NEW>> late(
+        std::move(waiting.back()));
+    waiting.pop_back();
+    late.transition<&Request::body>("Late");
+    // The others wait in a pool.
+    prot_enc::StatePool<RequestWrapper<RequestState::NEW>> pool;
+    for (auto& request : waiting) pool.insert(std::move(request));
+    std::cout << "in an AnyState and a pool:\n";
+    PrintCensus();
+
+    std::istringstream metrics(prot_enc::OpenMetricsText());
+    for (std::string line; std::getline(metrics, line);) {
+      if (line.find("HEADERS") != std::string::npos) std::cout << line << "\n";
+    }
+    const bool counted = Census::live(RequestState::HEADERS) == 3 &&
+                         Census::live(RequestState::BODY) == 1 &&
+                         Census::abandoned(RequestState::HEADERS) == 1;
+    return sent == 6 * 12 && counted ? 0 : 1;
+}
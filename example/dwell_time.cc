@@ -0,0 +1,86 @@
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "protenc.h"
+#include "protenc_dwell.h"
+#include "protenc_metrics.h"
+
+// Example use of the DwellTimePolicy, along with the MetricsPolicy: uploads
+// whose body arrives some time after the headers. The transitions themselves
+// are quick, the time is spent waiting in HEADERS.
+
+enum class UploadState { CONNECTED, HEADERS, BODY };
+
+template <UploadState>
+class UploadWrapper;
+
+class Upload {
+ public:
+  void headers(std::string headers) { headers_ = std::move(headers); }
+
+  void body(std::string body) { body_ = std::move(body); }
+
+  std::size_t store() && { return headers_.size() + body_.size(); }
+
+ private:
+  Upload() = default;
+
+  template <UploadState>
+  friend class ::UploadWrapper;
+
+  std::string headers_;
+  std::string body_;
+};
+
+using prot_enc::FinalTransition;
+using prot_enc::Transition;
+
+using UploadInitialStates = prot_enc::InitialStates<UploadState::CONNECTED>;
+using UploadTransitions = prot_enc::Transitions<
+    Transition<UploadState::CONNECTED, UploadState::HEADERS,
+               &Upload::headers>,
+    Transition<UploadState::HEADERS, UploadState::BODY, &Upload::body>>;
+using UploadFinalTransitions = prot_enc::FinalTransitions<
+    FinalTransition<UploadState::BODY, &Upload::store>>;
+using UploadValidQueries = prot_enc::ValidQueries<>;
+
+using UploadPolicy =
+    prot_enc::Policies<prot_enc::MetricsPolicy, prot_enc::DwellTimePolicy>;
+
+PROTENC_START_WRAPPER_WITH_POLICY(UploadWrapper, Upload, UploadState,
+                                  UploadInitialStates, UploadTransitions,
+                                  UploadFinalTransitions, UploadValidQueries,
+                                  UploadPolicy);
+  PROTENC_DECLARE_TRANSITION(headers);
+  PROTENC_DECLARE_TRANSITION(body);
+  PROTENC_DECLARE_FINAL_TRANSITION(store);
+PROTENC_END_WRAPPER;
+
+int main() {
+    std::size_t stored = 0;
+    for (int i = 0; i < 10; ++i) {
+      auto upload = UploadWrapper<UploadState::CONNECTED>().headers(
+          "Content-Type: text/plain");
+      // Waiting for the body.
+      std::this_thread::sleep_for(std::chrono::milliseconds(1 + i % 3));
+      stored += std::move(upload).body("Hello").store();
+    }
+    {
+      // Never gets its body: its time in HEADERS ends when it is dropped.
+      auto upload = UploadWrapper<UploadState::CONNECTED>().headers("");
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    // The dwell times, without the buckets.
+    std::istringstream metrics(prot_enc::OpenMetricsText());
+    for (std::string line; std::getline(metrics, line);) {
+      if (line.find("dwell") != std::string::npos &&
+          line.find("_bucket") == std::string::npos) {
+        std::cout << line << "\n";
+      }
+    }
+    return stored == 10 * 29 ? 0 : 1;
+}
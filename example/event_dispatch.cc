@@ -0,0 +1,56 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "http_connection.h"
+#include "protenc_dispatch.h"
+
+// Example use of the EventDispatcher: a stream of events on HTTP connection
+// builders stored in a StatePool, executed in batches grouped by (state,
+// method).
+
+using Dispatcher = prot_enc::EventDispatcher<
+    HTTPConnectionBuilderWrapper<HTTPBuilderState::START>>;
+
+int main() {
+    Dispatcher::Pool pool;
+    std::vector<prot_enc::PoolHandle> handles;
+    for (int i = 0; i < 100; ++i) {
+      handles.push_back(pool.insert(GetConnectionBuilder()));
+    }
+
+    // Every builder gets two headers and a body, and every tenth one gets an
+    // invalid extra header after its body.
+    std::vector<Dispatcher::Event> events;
+    for (int i = 0; i < 100; ++i) {
+      events.push_back(
+          Dispatcher::make_event<&HTTPConnectionBuilder::add_header>(
+              handles[i], "Host: example.com"));
+    }
+    for (int i = 0; i < 100; ++i) {
+      events.push_back(
+          Dispatcher::make_event<&HTTPConnectionBuilder::add_header>(
+              handles[i], "Accept: */*"));
+      events.push_back(
+          Dispatcher::make_event<&HTTPConnectionBuilder::add_body>(
+              handles[i], "Body"));
+      if (i % 10 == 0) {
+        // The method can also be chosen at runtime, by index.
+        events.push_back(Dispatcher::Event{
+            handles[i],
+            Dispatcher::Arguments(std::in_place_index<0>, "Too late")});
+      }
+    }
+    // A handle that the pool never gave out is rejected.
+    events.push_back(Dispatcher::make_event<&HTTPConnectionBuilder::add_header>(
+        prot_enc::PoolHandle{1000, 0}, "Forged"));
+
+    Dispatcher dispatcher;
+    std::vector<std::size_t> rejected;
+    std::size_t executed = dispatcher.dispatch(pool, events, rejected);
+
+    std::cout << "Executed " << executed << " events, rejected "
+              << rejected.size() << "; " << pool.size<HTTPBuilderState::BODY>()
+              << " builders have a body\n";
+    return executed == 300 && rejected.size() == 11 ? 0 : 1;
+}
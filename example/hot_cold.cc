@@ -0,0 +1,76 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "protenc.h"
+
+// Example use of the Hot/Cold annotations: an upload sends many chunks in a
+// loop (the hot transition), and rarely fails (the cold transitions, kept out
+// of the loop).
+
+enum class UploadState { OPEN, SENDING, FAILED };
+
+template <UploadState>
+class UploadWrapper;
+
+class Upload {
+ public:
+  void send(std::string chunk) { sent_ += chunk.size(); }
+
+  void fail(std::string reason) { reason_ = std::move(reason); }
+
+  std::size_t finish() && { return sent_; }
+
+  std::string error() && { return std::move(reason_); }
+
+ private:
+  Upload() = default;
+
+  template <UploadState>
+  friend class ::UploadWrapper;
+
+  std::size_t sent_ = 0;
+  std::string reason_;
+};
+
+using prot_enc::Cold;
+using prot_enc::FinalTransition;
+using prot_enc::Hot;
+using prot_enc::Transition;
+
+using UploadInitialStates = prot_enc::InitialStates<UploadState::OPEN>;
+using UploadTransitions = prot_enc::Transitions<
+    Transition<UploadState::OPEN, UploadState::SENDING, &Upload::send>,
+    Hot<Transition<UploadState::SENDING, UploadState::SENDING, &Upload::send>>,
+    Cold<Transition<UploadState::OPEN, UploadState::FAILED, &Upload::fail>>,
+    Cold<Transition<UploadState::SENDING, UploadState::FAILED, &Upload::fail>>>;
+using UploadFinalTransitions = prot_enc::FinalTransitions<
+    FinalTransition<UploadState::SENDING, &Upload::finish>,
+    Cold<FinalTransition<UploadState::FAILED, &Upload::error>>>;
+using UploadValidQueries = prot_enc::ValidQueries<>;
+
+PROTENC_START_WRAPPER(UploadWrapper, Upload, UploadState, UploadInitialStates,
+                      UploadTransitions, UploadFinalTransitions,
+                      UploadValidQueries);
+  PROTENC_DECLARE_TRANSITION(send);
+  PROTENC_DECLARE_TRANSITION(fail);
+  PROTENC_DECLARE_FINAL_TRANSITION(finish);
+  PROTENC_DECLARE_FINAL_TRANSITION(error);
+PROTENC_END_WRAPPER;
+
+int main() {
+    std::vector<std::string> chunks(1000, std::string(64, 'x'));
+    auto upload = UploadWrapper<UploadState::OPEN>().send(chunks[0]);
+    for (std::size_t i = 1; i < chunks.size(); ++i) {
+      upload = std::move(upload).send(chunks[i]);
+    }
+    const std::size_t sent = std::move(upload).finish();
+    std::cout << "Sent " << sent << " bytes\n";
+
+    std::string error = UploadWrapper<UploadState::OPEN>()
+                            .send(chunks[0])
+                            .fail("Connection reset")
+                            .error();
+    std::cout << "Failed upload: " << error << "\n";
+    return sent == 64000 && error == "Connection reset" ? 0 : 1;
+}
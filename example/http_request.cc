@@ -0,0 +1,28 @@
+#include <iostream>
+#include <string>
+
+#include "http_request.h"
+
+int main() {
+    std::string request = GetRequestBuilder()
+                              .start_line("POST", "/upload")
+                              .add_header("Host", "example.com")
+                              // No lookup of the name in the static table.
+                              .add_known_header(HTTPHeader::CONTENT_TYPE,
+                                                "text/plain")
+                              .add_header("X-Greeting", "hello")
+                              .add_body("Hello, world!")
+                              .build();
+    std::cout << request << "\n\n";
+
+    // No body: build from HEADERS.
+    auto headers = GetRequestBuilder()
+                       .start_line("GET", "/index.html")
+                       .add_header("Host", "example.com");
+    std::cout << "Size: " << headers.serialized_size() << "\n";
+    std::cout << std::move(headers).build();
+
+    // Does not compile: no request line.
+    // GetRequestBuilder().add_header("Host", "example.com");
+    return 0;
+}
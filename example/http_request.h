@@ -0,0 +1,495 @@
+#ifndef PROTENC_EXAMPLE_HTTP_REQUEST_H_
+#define PROTENC_EXAMPLE_HTTP_REQUEST_H_
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "protenc.h"
+#include "protenc_names.h"
+#include "protenc_recycling.h"
+
+// Example use of the ProtEnc library: an HTTP/1.1 request builder, serializing
+// the request in a single allocation.
+//
+// The protocol is:
+//
+//  *******                 *********             ******
+//  *START* ---start_line-> *HEADERS* ---body---> *BODY* -->build<--
+//  *******                 *********             ******
+//                           |  ^  | |
+//                           |  |  | -->build<--
+//                          header |
+//                                 |                **************
+//                                 -start_chunked-> *BODY_CHUNKED* -->finish<--
+//                                                  **************
+//                                                    |      ^
+//                                                    |      |
+//                                                    chunk
+//
+// Every transition adds the size of what it adds to the serialized size of the
+// request, so that build() allocates the request once, at its exact size.
+//
+// The names of the common headers (Host, Content-Type, ...) are in a static
+// table: such a header is stored as the one-byte index of its name, and the
+// serializer copies the name from the table. The other names and the values
+// are stored in one buffer. Along with the list of headers, it is reused from
+// one request to the next by the RecyclingPolicy: in steady state, building a
+// request only allocates the request itself.
+//
+// A body too large to hold in memory is streamed with the chunked transfer
+// encoding instead: start_chunked writes the headers to a file descriptor, and
+// then every chunk is written as soon as it is added, with its framing. The
+// protocol guarantees that the chunks come after the headers, and that the
+// terminating chunk comes last.
+
+enum class HTTPRequestState {
+  // Empty request.
+  START,
+  // Added the request line, and maybe headers.
+  HEADERS,
+  // Added the body.
+  BODY,
+  // Sent the headers, and maybe chunks of the body.
+  BODY_CHUNKED
+};
+
+// The headers with a name in the static table.
+enum class HTTPHeader : std::uint8_t {
+  ACCEPT,
+  ACCEPT_ENCODING,
+  ACCEPT_LANGUAGE,
+  AUTHORIZATION,
+  CACHE_CONTROL,
+  CONNECTION,
+  CONTENT_ENCODING,
+  CONTENT_TYPE,
+  COOKIE,
+  HOST,
+  IF_MODIFIED_SINCE,
+  IF_NONE_MATCH,
+  ORIGIN,
+  RANGE,
+  REFERER,
+  USER_AGENT,
+};
+
+// Names of the HTTPHeader values, and their perfect hash.
+constexpr std::array<std::string_view, 16> kHTTPHeaderNames = {
+    "Accept",        "Accept-Encoding",  "Accept-Language",
+    "Authorization", "Cache-Control",    "Connection",
+    "Content-Encoding", "Content-Type",  "Cookie",
+    "Host",          "If-Modified-Since", "If-None-Match",
+    "Origin",        "Range",            "Referer",
+    "User-Agent"};
+
+constexpr prot_enc::StaticNameMap<kHTTPHeaderNames.size()> kHTTPHeaderMap{
+    kHTTPHeaderNames};
+static_assert(kHTTPHeaderMap.built());
+
+template <HTTPRequestState>
+class HTTPRequestBuilderWrapper;
+
+class HTTPRequestBuilder {
+ public:
+  // "GET /index.html HTTP/1.1\r\n"
+  void start_line(std::string_view method, std::string_view target) {
+    text_.append(method).append(" ").append(target).append(" HTTP/1.1\r\n");
+    size_ += text_.size();
+  }
+
+  // "Host: example.com\r\n". If the name is in the static table (with the same
+  // case), only its index is stored.
+  void add_header(std::string_view name, std::string_view value) {
+    const std::size_t known = kHTTPHeaderMap.find(name);
+    if (known != kHTTPHeaderNames.size()) {
+      return add_known_header(static_cast<HTTPHeader>(known), value);
+    }
+    headers_.push_back(
+        Header{kCustomName, append_text(name), append_text(value)});
+    size_ += name.size() + value.size() + 4;
+  }
+
+  // "Host: example.com\r\n", with the name from the static table.
+  void add_known_header(HTTPHeader name, std::string_view value) {
+    const auto index = static_cast<std::uint8_t>(name);
+    headers_.push_back(Header{index, {}, append_text(value)});
+    size_ += kHTTPHeaderNames[index].size() + value.size() + 4;
+  }
+
+  // Followed by "Content-Length: ...\r\n" in the headers.
+  void add_body(std::string body) {
+    body_ = std::move(body);
+    has_body_ = true;
+    size_ += kContentLengthSize + num_digits(body_.size()) + 2 + body_.size();
+  }
+
+  // Number of bytes of the serialized request.
+  std::size_t serialized_size() const { return size_ + 2; }
+
+  // The serialized request.
+  std::string build() && {
+    std::string request(serialized_size(), '\0');
+    char* output = write_head(request.data());
+    if (has_body_) {
+      output = write(output, "Content-Length: ");
+      output = std::to_chars(output, request.data() + request.size(),
+                             body_.size()).ptr;
+      output = write(output, "\r\n");
+    }
+    output = write(output, "\r\n");
+    output = write(output, body_);
+    assert(output == request.data() + request.size());
+    return request;
+  }
+
+  // Write the headers to the file descriptor, followed by
+  // "Transfer-Encoding: chunked\r\n\r\n".
+  void start_chunked(int fd) {
+    fd_ = fd;
+    const std::string_view encoding = "Transfer-Encoding: chunked\r\n\r\n";
+    // Without a body, size_ is the size of the head.
+    std::string head(size_ + encoding.size(), '\0');
+    write(write_head(head.data()), encoding);
+    const iovec buffers[] = {as_iovec(head)};
+    write_all(buffers);
+  }
+
+  // Write "<size in hex>\r\n<chunk>\r\n". Empty chunks are skipped: the empty
+  // chunk marks the end of the body.
+  void add_chunk(std::string_view chunk) {
+    if (chunk.empty()) return;
+    char size[24];
+    char* end = std::to_chars(size, size + sizeof(size) - 2, chunk.size(),
+                              16).ptr;
+    *end++ = '\r';
+    *end++ = '\n';
+    const iovec buffers[] = {
+        as_iovec(std::string_view(size, end - size)), as_iovec(chunk),
+        as_iovec("\r\n")};
+    write_all(buffers);
+  }
+
+  // Write the terminating chunk. Returns whether all the writes succeeded.
+  bool finish() && {
+    const iovec buffers[] = {as_iovec("0\r\n\r\n")};
+    write_all(buffers);
+    return !write_failed_;
+  }
+
+  // Back to START, keeping the buffers (see RecyclingPolicy).
+  void reset() {
+    text_.clear();
+    headers_.clear();
+    body_.clear();
+    has_body_ = false;
+    size_ = 0;
+    fd_ = -1;
+    write_failed_ = false;
+  }
+
+ private:
+  HTTPRequestBuilder() = default;
+
+  template <HTTPRequestState>
+  friend class ::HTTPRequestBuilderWrapper;
+
+  static constexpr std::size_t kContentLengthSize =
+      sizeof("Content-Length: ") - 1;
+
+  // Part of text_.
+  struct Text {
+    std::uint32_t offset;
+    std::uint32_t size;
+  };
+
+  // Name of a header not in the static table.
+  static constexpr std::uint8_t kCustomName = 0xff;
+
+  struct Header {
+    // Index in kHTTPHeaderNames, or kCustomName.
+    std::uint8_t name;
+    // For kCustomName.
+    Text custom_name;
+    Text value;
+  };
+
+  Text append_text(std::string_view text) {
+    const Text result{static_cast<std::uint32_t>(text_.size()),
+                      static_cast<std::uint32_t>(text.size())};
+    text_.append(text);
+    return result;
+  }
+
+  std::string_view text(Text part) const {
+    return std::string_view(text_).substr(part.offset, part.size);
+  }
+
+  static char* write(char* output, std::string_view text) {
+    return std::copy(text.begin(), text.end(), output);
+  }
+
+  // Write the request line and the headers, which must fit. Returns the end
+  // of what was written.
+  char* write_head(char* output) const {
+    output = write(output, text(Text{0, request_line_size()}));
+    for (const Header& header : headers_) {
+      output = write(output, header.name == kCustomName
+                                 ? text(header.custom_name)
+                                 : kHTTPHeaderNames[header.name]);
+      output = write(output, ": ");
+      output = write(output, text(header.value));
+      output = write(output, "\r\n");
+    }
+    return output;
+  }
+
+  // The request line is at the start of text_, before the first header.
+  std::uint32_t request_line_size() const {
+    if (headers_.empty()) return static_cast<std::uint32_t>(text_.size());
+    const Header& first = headers_.front();
+    return first.name == kCustomName ? first.custom_name.offset
+                                     : first.value.offset;
+  }
+
+  static std::size_t num_digits(std::size_t value) {
+    std::size_t digits = 1;
+    for (; value >= 10; value /= 10) ++digits;
+    return digits;
+  }
+
+  static iovec as_iovec(std::string_view buffer) {
+    return iovec{const_cast<char*>(buffer.data()), buffer.size()};
+  }
+
+  // Write all the buffers to fd_, resuming after partial writes.
+  template <std::size_t N>
+  void write_all(const iovec (&buffers)[N]) {
+    iovec remaining[N];
+    std::copy(buffers, buffers + N, remaining);
+    iovec* first = remaining;
+    std::size_t count = N;
+    while (count > 0 && !write_failed_) {
+      ssize_t written = writev(fd_, first, static_cast<int>(count));
+      if (written < 0) {
+        write_failed_ = true;
+        return;
+      }
+      while (count > 0 &&
+             static_cast<std::size_t>(written) >= first->iov_len) {
+        written -= first->iov_len;
+        ++first;
+        --count;
+      }
+      if (count > 0) {
+        first->iov_base = static_cast<char*>(first->iov_base) + written;
+        first->iov_len -= written;
+      }
+    }
+  }
+
+  // The request line, then the names of the custom headers and the values.
+  std::string text_;
+  std::vector<Header> headers_;
+  std::string body_;
+  bool has_body_ = false;
+  // Serialized size, without the final empty line.
+  std::size_t size_ = 0;
+  // Where the chunked body is written.
+  int fd_ = -1;
+  bool write_failed_ = false;
+};
+
+using HTTPRequestInitialStates =
+    prot_enc::InitialStates<HTTPRequestState::START>;
+
+using HTTPRequestTransitions = prot_enc::Transitions<
+    prot_enc::Transition<HTTPRequestState::START, HTTPRequestState::HEADERS,
+                         &HTTPRequestBuilder::start_line>,
+    prot_enc::Transition<HTTPRequestState::HEADERS, HTTPRequestState::HEADERS,
+                         &HTTPRequestBuilder::add_header>,
+    prot_enc::Transition<HTTPRequestState::HEADERS, HTTPRequestState::HEADERS,
+                         &HTTPRequestBuilder::add_known_header>,
+    prot_enc::Transition<HTTPRequestState::HEADERS, HTTPRequestState::BODY,
+                         &HTTPRequestBuilder::add_body>,
+    prot_enc::Transition<HTTPRequestState::HEADERS,
+                         HTTPRequestState::BODY_CHUNKED,
+                         &HTTPRequestBuilder::start_chunked>,
+    prot_enc::Transition<HTTPRequestState::BODY_CHUNKED,
+                         HTTPRequestState::BODY_CHUNKED,
+                         &HTTPRequestBuilder::add_chunk>>;
+
+// A request can have no body.
+using HTTPRequestFinalTransitions = prot_enc::FinalTransitions<
+    prot_enc::FinalTransition<HTTPRequestState::HEADERS,
+                              &HTTPRequestBuilder::build>,
+    prot_enc::FinalTransition<HTTPRequestState::BODY,
+                              &HTTPRequestBuilder::build>,
+    prot_enc::FinalTransition<HTTPRequestState::BODY_CHUNKED,
+                              &HTTPRequestBuilder::finish>>;
+
+using HTTPRequestValidQueries = prot_enc::ValidQueries<
+    prot_enc::ValidQuery<HTTPRequestState::HEADERS,
+                         &HTTPRequestBuilder::serialized_size>,
+    prot_enc::ValidQuery<HTTPRequestState::BODY,
+                         &HTTPRequestBuilder::serialized_size>>;
+
+PROTENC_START_WRAPPER_WITH_POLICY(HTTPRequestBuilderWrapper,
+                                  HTTPRequestBuilder, HTTPRequestState,
+                                  HTTPRequestInitialStates,
+                                  HTTPRequestTransitions,
+                                  HTTPRequestFinalTransitions,
+                                  HTTPRequestValidQueries,
+                                  prot_enc::RecyclingPolicy<>);
+
+  PROTENC_DECLARE_TRANSITION(start_line);
+  PROTENC_DECLARE_TRANSITION(add_header);
+  PROTENC_DECLARE_TRANSITION(add_known_header);
+  PROTENC_DECLARE_TRANSITION(add_body);
+  PROTENC_DECLARE_TRANSITION(start_chunked);
+  PROTENC_DECLARE_TRANSITION(add_chunk);
+
+  PROTENC_DECLARE_FINAL_TRANSITION(build);
+  PROTENC_DECLARE_FINAL_TRANSITION(finish);
+
+  PROTENC_DECLARE_QUERY_METHOD(serialized_size);
+
+PROTENC_END_WRAPPER;
+
+inline HTTPRequestBuilderWrapper<HTTPRequestState::START> GetRequestBuilder() {
+  return {};
+}
+
+
+// Zero-copy mode: the same protocol, but the request is built as a list of
+// buffers for writev(), pointing to the method, target, header names and
+// values and body given to the transitions, and to static separators. Nothing
+// is copied, so those buffers must outlive the write.
+//
+// The list is a fixed-capacity array owned by the caller (e.g. on the stack),
+// which the wrapper borrows: a transition only moves a pointer. The ordering
+// of the protocol fixes the layout: the request line is always the first 4
+// entries, each header adds 4 entries, and the body adds the Content-Length
+// header, the empty line and the body. A request with more than kMaxHeaders
+// headers fails: finish() returns an empty list.
+class HTTPRequestIoVecs {
+ public:
+  static constexpr std::size_t kMaxHeaders = 32;
+  static constexpr std::size_t kCapacity = 4 + 4 * kMaxHeaders + 3 + 2;
+
+  HTTPRequestIoVecs() = default;
+  // The entries point into the object.
+  HTTPRequestIoVecs(const HTTPRequestIoVecs&) = delete;
+  HTTPRequestIoVecs& operator=(const HTTPRequestIoVecs&) = delete;
+
+  void start_line(std::string_view method, std::string_view target) {
+    size_ = 0;
+    num_bytes_ = 0;
+    num_headers_ = 0;
+    has_body_ = false;
+    add(method);
+    add(" ");
+    add(target);
+    add(" HTTP/1.1\r\n");
+  }
+
+  void add_header(std::string_view name, std::string_view value) {
+    // The header is dropped, and the request fails.
+    if (++num_headers_ > kMaxHeaders) return;
+    add(name);
+    add(": ");
+    add(value);
+    add("\r\n");
+  }
+
+  void add_body(std::string_view body) {
+    const auto end = std::to_chars(content_length_,
+                                   content_length_ + sizeof(content_length_),
+                                   body.size()).ptr;
+    add("Content-Length: ");
+    add(std::string_view(content_length_, end - content_length_));
+    add("\r\n\r\n");
+    add(body);
+    has_body_ = true;
+  }
+
+  // Total size of the request.
+  std::size_t num_bytes() const { return num_bytes_; }
+
+  // The list of buffers, for writev(). Empty if there were too many headers.
+  std::span<const iovec> finish() && {
+    if (num_headers_ > kMaxHeaders) return {};
+    if (!has_body_) add("\r\n");
+    return std::span<const iovec>(entries_.data(), size_);
+  }
+
+ private:
+  void add(std::string_view buffer) {
+    entries_[size_++] = iovec{const_cast<char*>(buffer.data()), buffer.size()};
+    num_bytes_ += buffer.size();
+  }
+
+  std::array<iovec, kCapacity> entries_;
+  std::size_t size_ = 0;
+  std::size_t num_bytes_ = 0;
+  std::size_t num_headers_ = 0;
+  bool has_body_ = false;
+  char content_length_[24];
+};
+
+using HTTPRequestIoVecsTransitions = prot_enc::Transitions<
+    prot_enc::Transition<HTTPRequestState::START, HTTPRequestState::HEADERS,
+                         &HTTPRequestIoVecs::start_line>,
+    prot_enc::Transition<HTTPRequestState::HEADERS, HTTPRequestState::HEADERS,
+                         &HTTPRequestIoVecs::add_header>,
+    prot_enc::Transition<HTTPRequestState::HEADERS, HTTPRequestState::BODY,
+                         &HTTPRequestIoVecs::add_body>>;
+
+using HTTPRequestIoVecsFinalTransitions = prot_enc::FinalTransitions<
+    prot_enc::FinalTransition<HTTPRequestState::HEADERS,
+                              &HTTPRequestIoVecs::finish>,
+    prot_enc::FinalTransition<HTTPRequestState::BODY,
+                              &HTTPRequestIoVecs::finish>>;
+
+using HTTPRequestIoVecsValidQueries = prot_enc::ValidQueries<
+    prot_enc::ValidQuery<HTTPRequestState::HEADERS,
+                         &HTTPRequestIoVecs::num_bytes>,
+    prot_enc::ValidQuery<HTTPRequestState::BODY,
+                         &HTTPRequestIoVecs::num_bytes>>;
+
+using BorrowedHTTPRequestIoVecs = prot_enc::Borrowed<HTTPRequestIoVecs>;
+
+PROTENC_START_WRAPPER(HTTPRequestIoVecsBuilder, BorrowedHTTPRequestIoVecs,
+                      HTTPRequestState, HTTPRequestInitialStates,
+                      HTTPRequestIoVecsTransitions,
+                      HTTPRequestIoVecsFinalTransitions,
+                      HTTPRequestIoVecsValidQueries);
+
+  PROTENC_DECLARE_TRANSITION(start_line);
+  PROTENC_DECLARE_TRANSITION(add_header);
+  PROTENC_DECLARE_TRANSITION(add_body);
+
+  PROTENC_DECLARE_FINAL_TRANSITION(finish);
+
+  PROTENC_DECLARE_QUERY_METHOD(num_bytes);
+
+PROTENC_END_WRAPPER;
+
+// Build the request in the given list of buffers.
+inline HTTPRequestIoVecsBuilder<HTTPRequestState::START>
+GetRequestIoVecsBuilder(HTTPRequestIoVecs& iovecs) {
+  return HTTPRequestIoVecsBuilder<HTTPRequestState::START>::borrow(iovecs);
+}
+
+#endif // PROTENC_EXAMPLE_HTTP_REQUEST_H_
@@ -0,0 +1,78 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+#include "http_request.h"
+
+// Example use of the chunked body of the HTTP request builder: a 4MB body is
+// streamed to a file in chunks of 64kB, only one of which is in memory at a
+// time. The file is then read back, and the body decoded.
+
+constexpr std::size_t kChunkSize = 64 * 1024;
+constexpr std::size_t kNumChunks = 64;
+
+// Decode the chunked body of the request. Returns false if the framing is
+// wrong.
+bool DecodeChunkedBody(const std::string& request, std::string& body) {
+  std::size_t position = request.find("\r\n\r\n");
+  if (position == std::string::npos) return false;
+  position += 4;
+  while (true) {
+    const std::size_t line_end = request.find("\r\n", position);
+    if (line_end == std::string::npos) return false;
+    const std::size_t size = std::stoul(
+        request.substr(position, line_end - position), nullptr, 16);
+    position = line_end + 2;
+    if (size == 0) {
+      return request.compare(position, std::string::npos, "\r\n") == 0;
+    }
+    body.append(request, position, size);
+    position += size;
+    if (request.compare(position, 2, "\r\n") != 0) return false;
+    position += 2;
+  }
+}
+
+int main() {
+    char path[] = "/tmp/protenc_chunked_XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd < 0) {
+      std::cerr << "Could not create a temporary file\n";
+      return 1;
+    }
+
+    auto chunked = GetRequestBuilder()
+                       .start_line("PUT", "/upload")
+                       .add_header("Host", "example.com")
+                       .start_chunked(fd);
+    // The only buffer of the body.
+    std::string chunk(kChunkSize, '\0');
+    for (std::size_t i = 0; i < kNumChunks; ++i) {
+      chunk.assign(kChunkSize, static_cast<char>('a' + i % 26));
+      chunked = std::move(chunked).add_chunk(chunk);
+    }
+    // Does not compile: the headers were already sent.
+    // std::move(chunked).add_header("Late", "header");
+    const bool written = std::move(chunked).finish();
+    close(fd);
+
+    std::ifstream file(path, std::ios::binary);
+    const std::string request((std::istreambuf_iterator<char>(file)),
+                              std::istreambuf_iterator<char>());
+    unlink(path);
+    std::cout << request.substr(0, request.find("\r\n\r\n") + 4);
+
+    std::string body;
+    if (!written || !DecodeChunkedBody(request, body)) {
+      std::cout << "Invalid chunked request\n";
+      return 1;
+    }
+    std::cout << "Decoded a body of " << body.size() << " bytes, sent in "
+              << kNumChunks << " chunks of " << kChunkSize << " bytes\n";
+    return body.size() == kChunkSize * kNumChunks ? 0 : 1;
+}
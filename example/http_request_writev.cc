@@ -0,0 +1,66 @@
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <span>
+#include <string>
+
+#include "http_request.h"
+
+// Example use of the zero-copy mode of the HTTP request builder: the request
+// is written to a pipe with a single writev(), without copying the body, and
+// read back to compare it with the serialized request.
+
+int main() {
+    const std::string body(10000, 'x');
+
+    HTTPRequestIoVecs iovecs;
+    auto builder = GetRequestIoVecsBuilder(iovecs)
+                       .start_line("POST", "/upload")
+                       .add_header("Host", "example.com")
+                       .add_header("Content-Type", "text/plain")
+                       .add_body(body);
+    const std::size_t num_bytes = builder.num_bytes();
+    std::span<const iovec> request = std::move(builder).finish();
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+      std::cerr << "pipe failed\n";
+      return 1;
+    }
+    const ssize_t written =
+        writev(fds[1], request.data(), static_cast<int>(request.size()));
+    close(fds[1]);
+    std::cout << "Wrote " << written << " bytes in " << request.size()
+              << " buffers\n";
+
+    std::string received(num_bytes, '\0');
+    std::size_t offset = 0;
+    while (offset < received.size()) {
+      const ssize_t count =
+          read(fds[0], received.data() + offset, received.size() - offset);
+      if (count <= 0) break;
+      offset += count;
+    }
+    close(fds[0]);
+
+    const std::string expected = GetRequestBuilder()
+                                     .start_line("POST", "/upload")
+                                     .add_header("Host", "example.com")
+                                     .add_header("Content-Type", "text/plain")
+                                     .add_body(body)
+                                     .build();
+    const bool same = received == expected;
+    std::cout << (same ? "Same as the serialized request\n"
+                       : "Different from the serialized request!\n");
+
+    // One header too many: the request fails.
+    auto too_many = GetRequestIoVecsBuilder(iovecs).start_line("GET", "/");
+    for (std::size_t i = 0; i <= HTTPRequestIoVecs::kMaxHeaders; ++i) {
+      too_many = std::move(too_many).add_header("X-Header", "value");
+    }
+    const bool rejected = std::move(too_many).finish().empty();
+    std::cout << (rejected ? "Rejected a request with too many headers\n"
+                           : "Accepted a request with too many headers!\n");
+    return same && rejected ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+#include <iostream>
+#include <string_view>
+
+#include "http_response.h"
+
+// Example use of the HTTP response parser, on two responses in a row, then on
+// invalid ones.
+
+int main() {
+    constexpr std::string_view input =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain\r\n"
+        "Content-Length: 13\r\n"
+        "\r\n"
+        "Hello, world!"
+        "HTTP/1.1 404 Not Found\r\n"
+        "Content-Length: 0\r\n"
+        "\r\n";
+
+    std::string_view rest = input;
+    while (!rest.empty()) {
+      auto parser = GetResponseParser().status_line(rest);
+      std::cout << parser.status_code() << " " << parser.reason() << "\n";
+      // Does not compile: the headers are not parsed yet.
+      // std::move(parser).body();
+      while (!parser.at_end_of_headers()) {
+        parser = std::move(parser).next_header();
+        std::cout << "  " << parser.header_name() << " = "
+                  << parser.header_value() << "\n";
+      }
+      HTTPResponse response = std::move(parser).end_headers().body();
+      if (response.failed) {
+        std::cout << "Invalid response\n";
+        return 1;
+      }
+      std::cout << "  body: \"" << response.body << "\"\n";
+      rest = response.rest;
+    }
+
+    // A status line without its "\r\n", and a signed status code.
+    for (std::string_view invalid : {std::string_view("HTTP/1.1 200 OK"),
+                                     std::string_view("HTTP/1.1 -20 OK\r\n"
+                                                      "\r\n")}) {
+      auto parser = GetResponseParser().status_line(invalid);
+      while (!parser.at_end_of_headers()) {
+        parser = std::move(parser).next_header();
+      }
+      if (!std::move(parser).end_headers().body().failed) {
+        std::cout << "Accepted an invalid status line!\n";
+        return 1;
+      }
+    }
+    std::cout << "Rejected the invalid status lines\n";
+
+    // end_headers() without the empty line.
+    auto parser = GetResponseParser().status_line("HTTP/1.1 200 OK\r\n"
+                                                  "Content-Length: 4\r\n");
+    if (!std::move(parser).end_headers().body().failed) {
+      std::cout << "Accepted headers without the empty line!\n";
+      return 1;
+    }
+    std::cout << "Rejected headers without the empty line\n";
+    return 0;
+}
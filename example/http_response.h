@@ -0,0 +1,272 @@
+#ifndef PROTENC_EXAMPLE_HTTP_RESPONSE_H_
+#define PROTENC_EXAMPLE_HTTP_RESPONSE_H_
+
+#include <charconv>
+#include <cstddef>
+#include <string_view>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "protenc.h"
+
+// Example use of the ProtEnc library: an HTTP/1.1 response parser.
+//
+// The protocol is:
+//
+//  *************                 *********                  ******
+//  *STATUS_LINE* --status_line-> *HEADERS* --end_headers--> *BODY* -->body<--
+//  *************                 *********                  ******
+//                                 |     ^
+//                                 |     |
+//                                 next_header
+//
+// Each transition consumes its part of the input: the status line, one header
+// line, or the empty line ending the headers. The parser has no runtime phase:
+// the protocol guarantees that the headers are not read before the status
+// line, nor the body before the end of the headers. The delimiters ("\r\n" and
+// ':') are found with SIMD comparisons of 16 or 32 bytes at a time.
+//
+// The input is a buffer of one or more complete responses (e.g. a capture of
+// the traffic): the final transition returns the body, and the rest of the
+// input, starting with the next response. The body is given by the
+// Content-Length header (chunked bodies are not supported).
+
+namespace http_scan {
+
+// Position of the first c1 or c2 in [data, data + size), or size.
+inline std::size_t find_either(const char* data, std::size_t size, char c1,
+                               char c2) {
+  std::size_t i = 0;
+#if defined(__AVX2__)
+  const __m256i wide1 = _mm256_set1_epi8(c1);
+  const __m256i wide2 = _mm256_set1_epi8(c2);
+  for (; i + 32 <= size; i += 32) {
+    const __m256i block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(block, wide1),
+                        _mm256_cmpeq_epi8(block, wide2))));
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+#endif
+#if defined(__SSE2__)
+  const __m128i v1 = _mm_set1_epi8(c1);
+  const __m128i v2 = _mm_set1_epi8(c2);
+  for (; i + 16 <= size; i += 16) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(block, v1), _mm_cmpeq_epi8(block, v2))));
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+#endif
+  for (; i < size; ++i) {
+    if (data[i] == c1 || data[i] == c2) return i;
+  }
+  return size;
+}
+
+// Position of the first "\r\n" in the input, or input.size().
+inline std::size_t find_line_end(std::string_view input, std::size_t from = 0) {
+  while (from < input.size()) {
+    const std::size_t position = from + find_either(input.data() + from,
+                                                    input.size() - from, '\r',
+                                                    '\r');
+    if (position + 1 >= input.size()) return input.size();
+    if (input[position + 1] == '\n') return position;
+    from = position + 1;
+  }
+  return input.size();
+}
+
+inline bool equals_ignoring_case(std::string_view a, std::string_view b) {
+  if (a.size() != b.size()) return false;
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    if ((a[i] | 0x20) != (b[i] | 0x20)) return false;
+  }
+  return true;
+}
+
+inline std::string_view trim(std::string_view text) {
+  while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+    text.remove_prefix(1);
+  }
+  while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) {
+    text.remove_suffix(1);
+  }
+  return text;
+}
+
+} // namespace http_scan
+
+enum class HTTPResponseState {
+  // Nothing parsed.
+  STATUS_LINE,
+  // Parsed the status line, and maybe headers.
+  HEADERS,
+  // Parsed the empty line after the headers.
+  BODY
+};
+
+// A parsed response, and what follows it in the input.
+struct HTTPResponse {
+  int status_code;
+  std::string_view body;
+  std::string_view rest;
+  // Whether the response was malformed or truncated; the other fields are
+  // then meaningless.
+  bool failed;
+};
+
+template <HTTPResponseState>
+class HTTPResponseParserWrapper;
+
+class HTTPResponseParser {
+ public:
+  // "HTTP/1.1 200 OK\r\n", at the start of the input.
+  void status_line(std::string_view input) {
+    input_ = input;
+    const std::size_t end = http_scan::find_line_end(input_);
+    if (end == input_.size()) return fail();
+    // "HTTP/1.x ddd" at least.
+    if (end < 12 || input_.substr(0, 7) != "HTTP/1." || input_[8] != ' ') {
+      return fail();
+    }
+    // Three digits: from_chars would also take a sign.
+    status_code_ = 0;
+    for (std::size_t i = 9; i < 12; ++i) {
+      if (input_[i] < '0' || input_[i] > '9') return fail();
+      status_code_ = status_code_ * 10 + (input_[i] - '0');
+    }
+    reason_ = http_scan::trim(input_.substr(12, end - 12));
+    input_.remove_prefix(end + 2);
+  }
+
+  // Whether the next line is the empty line ending the headers (or the
+  // parsing failed).
+  bool at_end_of_headers() const {
+    return failed_ || input_.substr(0, 2) == "\r\n";
+  }
+
+  // "Name: value\r\n": parse the next header line.
+  void next_header() {
+    if (failed_) return;
+    const std::size_t colon =
+        http_scan::find_either(input_.data(), input_.size(), ':', '\r');
+    if (colon == input_.size() || input_[colon] != ':') return fail();
+    const std::size_t end = http_scan::find_line_end(input_, colon + 1);
+    if (end == input_.size()) return fail();
+    header_name_ = input_.substr(0, colon);
+    header_value_ = http_scan::trim(input_.substr(colon + 1, end - colon - 1));
+    if (http_scan::equals_ignoring_case(header_name_, "content-length")) {
+      const auto result =
+          std::from_chars(header_value_.data(),
+                          header_value_.data() + header_value_.size(),
+                          content_length_);
+      if (result.ptr != header_value_.data() + header_value_.size()) {
+        return fail();
+      }
+    }
+    input_.remove_prefix(end + 2);
+  }
+
+  // The header parsed by the last next_header().
+  std::string_view header_name() const { return header_name_; }
+  std::string_view header_value() const { return header_value_; }
+
+  int status_code() const { return status_code_; }
+  std::string_view reason() const { return reason_; }
+
+  // Consume the empty line.
+  void end_headers() {
+    if (failed_) return;
+    if (input_.substr(0, 2) != "\r\n") return fail();
+    input_.remove_prefix(2);
+  }
+
+  HTTPResponse body() && {
+    if (failed_ || content_length_ > input_.size()) {
+      return HTTPResponse{status_code_, {}, {}, true};
+    }
+    return HTTPResponse{status_code_, input_.substr(0, content_length_),
+                        input_.substr(content_length_), false};
+  }
+
+ private:
+  HTTPResponseParser() = default;
+
+  template <HTTPResponseState>
+  friend class ::HTTPResponseParserWrapper;
+
+  void fail() {
+    failed_ = true;
+    input_ = {};
+  }
+
+  // What is left to parse.
+  std::string_view input_;
+  int status_code_ = 0;
+  std::string_view reason_;
+  std::string_view header_name_;
+  std::string_view header_value_;
+  std::size_t content_length_ = 0;
+  bool failed_ = false;
+};
+
+using HTTPResponseInitialStates =
+    prot_enc::InitialStates<HTTPResponseState::STATUS_LINE>;
+
+using HTTPResponseTransitions = prot_enc::Transitions<
+    prot_enc::Transition<HTTPResponseState::STATUS_LINE,
+                         HTTPResponseState::HEADERS,
+                         &HTTPResponseParser::status_line>,
+    prot_enc::Transition<HTTPResponseState::HEADERS, HTTPResponseState::HEADERS,
+                         &HTTPResponseParser::next_header>,
+    prot_enc::Transition<HTTPResponseState::HEADERS, HTTPResponseState::BODY,
+                         &HTTPResponseParser::end_headers>>;
+
+using HTTPResponseFinalTransitions = prot_enc::FinalTransitions<
+    prot_enc::FinalTransition<HTTPResponseState::BODY,
+                              &HTTPResponseParser::body>>;
+
+using HTTPResponseValidQueries = prot_enc::ValidQueries<
+    prot_enc::ValidQuery<HTTPResponseState::HEADERS,
+                         &HTTPResponseParser::at_end_of_headers>,
+    prot_enc::ValidQuery<HTTPResponseState::HEADERS,
+                         &HTTPResponseParser::header_name>,
+    prot_enc::ValidQuery<HTTPResponseState::HEADERS,
+                         &HTTPResponseParser::header_value>,
+    prot_enc::ValidQuery<HTTPResponseState::HEADERS,
+                         &HTTPResponseParser::status_code>,
+    prot_enc::ValidQuery<HTTPResponseState::HEADERS,
+                         &HTTPResponseParser::reason>,
+    prot_enc::ValidQuery<HTTPResponseState::BODY,
+                         &HTTPResponseParser::status_code>>;
+
+PROTENC_START_WRAPPER(HTTPResponseParserWrapper, HTTPResponseParser,
+                      HTTPResponseState, HTTPResponseInitialStates,
+                      HTTPResponseTransitions, HTTPResponseFinalTransitions,
+                      HTTPResponseValidQueries);
+
+  PROTENC_DECLARE_TRANSITION(status_line);
+  PROTENC_DECLARE_TRANSITION(next_header);
+  PROTENC_DECLARE_TRANSITION(end_headers);
+
+  PROTENC_DECLARE_FINAL_TRANSITION(body);
+
+  PROTENC_DECLARE_QUERY_METHOD(at_end_of_headers);
+  PROTENC_DECLARE_QUERY_METHOD(header_name);
+  PROTENC_DECLARE_QUERY_METHOD(header_value);
+  PROTENC_DECLARE_QUERY_METHOD(status_code);
+  PROTENC_DECLARE_QUERY_METHOD(reason);
+
+PROTENC_END_WRAPPER;
+
+inline HTTPResponseParserWrapper<HTTPResponseState::STATUS_LINE>
+GetResponseParser() {
+  return {};
+}
+
+#endif // PROTENC_EXAMPLE_HTTP_RESPONSE_H_
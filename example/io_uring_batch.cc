@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "io_uring_batch.h"
+
+// Example use of the io_uring submission builder: write blocks to a file, each
+// linked to a read of the block back, in one batch. Then a chain of linked
+// entries too long for its ring is rejected.
+
+constexpr std::size_t kNumBlocks = 64;
+constexpr std::size_t kBlockSize = 4096;
+
+using Block = std::array<std::byte, kBlockSize>;
+
+// The same with pwrite and pread, where io_uring is not available.
+bool WriteAndReadBack(int fd, const std::vector<Block>& blocks,
+                      std::vector<Block>& read_blocks) {
+  for (std::size_t i = 0; i < kNumBlocks; ++i) {
+    const off_t offset = static_cast<off_t>(i * kBlockSize);
+    if (pwrite(fd, blocks[i].data(), kBlockSize, offset) !=
+            static_cast<ssize_t>(kBlockSize) ||
+        pread(fd, read_blocks[i].data(), kBlockSize, offset) !=
+            static_cast<ssize_t>(kBlockSize)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool WriteAndReadBack(IoUring& ring, int fd, const std::vector<Block>& blocks,
+                      std::vector<Block>& read_blocks) {
+  auto batch = GetSubmissionBuilder(ring);
+  for (std::size_t i = 0; i < kNumBlocks; ++i) {
+    const std::uint64_t offset = i * kBlockSize;
+    batch = std::move(batch)
+                .get_sqe()
+                .prep_write(fd, blocks[i], offset)
+                // The read starts after the write completed.
+                .set_flags(IOSQE_IO_LINK)
+                .set_user_data(2 * i)
+                .commit()
+                .get_sqe()
+                .prep_read(fd, read_blocks[i], offset)
+                .set_user_data(2 * i + 1)
+                .commit();
+  }
+  // Does not compile: the entry is not tagged with its user data.
+  // std::move(batch).get_sqe().prep_read(fd, read_blocks[0], 0).commit();
+  // Does not compile: the last entry is not committed.
+  // std::move(batch).get_sqe().submit();
+  if (std::move(batch).submit_and_wait(2 * kNumBlocks) < 0) return false;
+
+  bool ok = true;
+  for (std::size_t i = 0; i < 2 * kNumBlocks; ++i) {
+    const io_uring_cqe completion = ring.wait_completion();
+    if (completion.res != static_cast<int>(kBlockSize)) {
+      std::cerr << "Operation " << completion.user_data << " failed: "
+                << (completion.res < 0 ? std::strerror(-completion.res)
+                                       : "short transfer")
+                << "\n";
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+// A chain of linked writes longer than the ring: get_sqe() can't submit in the
+// middle of the chain, so the end of the batch is dropped, and submit() fails.
+bool RejectsLongChain(int fd, const std::vector<Block>& blocks) {
+  IoUring ring(4);
+  if (ring.error() != 0) return true;
+  auto batch = GetSubmissionBuilder(ring);
+  for (std::size_t i = 0; i < 8; ++i) {
+    batch = std::move(batch)
+                .get_sqe()
+                .prep_write(fd, blocks[i], i * kBlockSize)
+                .set_flags(IOSQE_IO_LINK)
+                .set_user_data(i)
+                .commit();
+  }
+  if (std::move(batch).submit() != -EBUSY) return false;
+  // The entries committed before the ring was full were submitted.
+  for (int i = 0; i < 4; ++i) ring.wait_completion();
+  return true;
+}
+
+int main() {
+    char path[] = "/tmp/protenc_io_uring_XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd < 0) {
+      std::cerr << "Could not create a temporary file\n";
+      return 1;
+    }
+    unlink(path);
+
+    std::vector<Block> blocks(kNumBlocks);
+    for (std::size_t i = 0; i < kNumBlocks; ++i) {
+      blocks[i].fill(static_cast<std::byte>(i));
+    }
+    std::vector<Block> read_blocks(kNumBlocks);
+
+    IoUring ring(2 * kNumBlocks);
+    bool ok;
+    if (ring.error() == 0) {
+      ok = WriteAndReadBack(ring, fd, blocks, read_blocks);
+      std::cout << "Wrote and read back " << kNumBlocks
+                << " blocks in one io_uring batch\n";
+    } else {
+      std::cout << "io_uring is not available (" << std::strerror(ring.error())
+                << "), falling back to pwrite and pread\n";
+      ok = WriteAndReadBack(fd, blocks, read_blocks);
+    }
+    if (!ok || blocks != read_blocks) {
+      std::cerr << "The blocks read back differ\n";
+      close(fd);
+      return 1;
+    }
+    if (!RejectsLongChain(fd, blocks)) {
+      std::cerr << "A chain longer than the ring was not rejected\n";
+      close(fd);
+      return 1;
+    }
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,325 @@
+#ifndef PROTENC_EXAMPLE_IO_URING_BATCH_H_
+#define PROTENC_EXAMPLE_IO_URING_BATCH_H_
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+
+#include "protenc.h"
+
+// Example use of the ProtEnc library: batches of asynchronous file I/O with
+// io_uring, without liburing (the ring is set up with the raw syscalls).
+//
+// A submission queue entry (SQE) is filled with the protocol:
+//
+//  ******            **********                **********
+//  *IDLE* -get_sqe-> *ACQUIRED* --prep_read--> *PREPARED* <--
+//  ******            ********** --prep_write-> **********   |
+//   |  ^                                        |     |      set_flags
+//   |  |                                        |     --------
+//   |  |             ********                   |
+//   |  ----commit--- *TAGGED* <--set_user_data---
+//   |                ********
+//   -->submit<--
+//   -->submit_and_wait<--
+//
+// so that every entry is prepared, tagged with its user data, then committed,
+// and that the batch is only submitted between two entries: the kernel never
+// sees a half-prepared entry. None of these steps checks a state at runtime;
+// get_sqe() only checks that the ring has room, submitting the pending entries
+// if it doesn't. A submission ends the chains of IOSQE_IO_LINK entries, so
+// get_sqe() doesn't submit after a linked entry: size the ring for the chains
+// of a batch. If the ring stays full, get_sqe() stops handing out entries:
+// the rest of the batch is dropped, and submit() returns the error.
+//
+// The builder borrows the ring, which reaps the completions:
+//   IoUring ring(64);
+//   GetSubmissionBuilder(ring)
+//       .get_sqe().prep_read(fd, buffer, 0).set_user_data(1).commit()
+//       .submit_and_wait(1);
+//   io_uring_cqe completion = ring.wait_completion();
+
+enum class IoUringSqeState {
+  // Between two entries.
+  IDLE,
+  // Got an entry, not filled yet.
+  ACQUIRED,
+  // The operation is set, the user data isn't.
+  PREPARED,
+  // Ready to be committed.
+  TAGGED,
+};
+
+template <IoUringSqeState>
+class IoUringSubmissionBuilder;
+
+class IoUring {
+ public:
+  // Set up a ring of at least the given number of entries. io_uring may not be
+  // available (old kernel, seccomp filter): check error() before use.
+  explicit IoUring(unsigned entries) {
+    io_uring_params params{};
+    fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd_ < 0) {
+      error_ = errno;
+      return;
+    }
+    sq_ring_size_ =
+        params.sq_off.array + params.sq_entries * sizeof(std::uint32_t);
+    cq_ring_size_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    // Since Linux 5.4, both rings are in one mapping.
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap && cq_ring_size_ > sq_ring_size_) {
+      sq_ring_size_ = cq_ring_size_;
+    }
+    sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+    cq_ring_ = single_mmap ? sq_ring_ : map(cq_ring_size_, IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(map(sqes_size_, IORING_OFF_SQES));
+    if (error_ != 0) return;
+
+    sq_head_ = field(sq_ring_, params.sq_off.head);
+    sq_tail_ = field(sq_ring_, params.sq_off.tail);
+    sq_mask_ = *field(sq_ring_, params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    // The entries are used in order: entry i is always at index i.
+    std::uint32_t* array = field(sq_ring_, params.sq_off.array);
+    for (std::uint32_t i = 0; i < sq_entries_; ++i) array[i] = i;
+    sq_local_tail_ = *sq_tail_;
+
+    cq_head_ = field(cq_ring_, params.cq_off.head);
+    cq_tail_ = field(cq_ring_, params.cq_off.tail);
+    cq_mask_ = *field(cq_ring_, params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(static_cast<char*>(cq_ring_) +
+                                            params.cq_off.cqes);
+  }
+
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  ~IoUring() {
+    if (sqes_ != nullptr) munmap(sqes_, sqes_size_);
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != nullptr) munmap(sq_ring_, sq_ring_size_);
+    if (fd_ >= 0) close(fd_);
+  }
+
+  // The errno of the setup, or 0.
+  int error() const { return error_; }
+
+  /* Submission: the functions of the protocol. */
+
+  void get_sqe() {
+    if (dropped_error_ == 0 && ring_full()) [[unlikely]] {
+      // Submitting would end the chain of the last entry.
+      const int result = linked_ ? -EBUSY : enter(num_unsubmitted_, 0, 0);
+      if (result < 0) {
+        dropped_error_ = result;
+      } else if (ring_full()) {
+        dropped_error_ = -EBUSY;
+      }
+    }
+    sqe_ = dropped_error_ != 0 ? dropped_sqe_.get()
+                               : &sqes_[sq_local_tail_ & sq_mask_];
+  }
+
+  // Read from the file at the offset into the buffer.
+  void prep_read(int fd, std::span<std::byte> buffer, std::uint64_t offset) {
+    prep(IORING_OP_READ, fd, buffer.data(), buffer.size(), offset);
+  }
+
+  // Write the buffer to the file at the offset.
+  void prep_write(int fd, std::span<const std::byte> buffer,
+                  std::uint64_t offset) {
+    prep(IORING_OP_WRITE, fd, buffer.data(), buffer.size(), offset);
+  }
+
+  // IOSQE_* flags, e.g. IOSQE_IO_LINK to start the next entry only after this
+  // one completed.
+  void set_flags(std::uint8_t flags) { sqe_->flags |= flags; }
+
+  // Given back in the completion.
+  void set_user_data(std::uint64_t user_data) { sqe_->user_data = user_data; }
+
+  // Make the entry visible to the kernel.
+  void commit() {
+    if (dropped_error_ != 0) return;
+    linked_ = sqe_->flags & IOSQE_IO_LINK;
+    ++num_unsubmitted_;
+    __atomic_store_n(sq_tail_, ++sq_local_tail_, __ATOMIC_RELEASE);
+  }
+
+  // Submit the committed entries. Returns the number of entries submitted,
+  // or -errno. If get_sqe() dropped the end of the batch, the entries
+  // committed before are still submitted, but the result is the -errno of the
+  // full ring (-EBUSY if the kernel didn't make room).
+  int submit() && { return end_batch(enter(num_unsubmitted_, 0, 0)); }
+
+  // Submit the committed entries, and wait for the given number of
+  // completions (not waiting if the end of the batch was dropped).
+  int submit_and_wait(unsigned num_completions) && {
+    if (dropped_error_ != 0) return std::move(*this).submit();
+    return end_batch(
+        enter(num_unsubmitted_, num_completions, IORING_ENTER_GETEVENTS));
+  }
+
+  /* Completion. */
+
+  // The next completion, waiting for it if there is none. Its res is the
+  // result of the operation (bytes read or written, or -errno), or -errno of
+  // io_uring_enter if waiting failed.
+  io_uring_cqe wait_completion() {
+    while (true) {
+      const std::uint32_t head = *cq_head_;
+      if (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        const io_uring_cqe completion = cqes_[head & cq_mask_];
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        return completion;
+      }
+      const int result = enter(0, 1, IORING_ENTER_GETEVENTS);
+      if (result < 0 && result != -EINTR) return io_uring_cqe{0, result, 0};
+    }
+  }
+
+ private:
+  void* map(std::size_t size, off_t offset) {
+    if (error_ != 0) return nullptr;
+    void* result = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd_, offset);
+    if (result != MAP_FAILED) return result;
+    error_ = errno;
+    return nullptr;
+  }
+
+  bool ring_full() const {
+    return sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) ==
+           sq_entries_;
+  }
+
+  // The result of the submission of a batch, or the error that dropped its
+  // end.
+  int end_batch(int result) {
+    linked_ = false;
+    if (dropped_error_ == 0) return result;
+    result = dropped_error_;
+    dropped_error_ = 0;
+    return result;
+  }
+
+  static std::uint32_t* field(void* ring, std::uint32_t offset) {
+    return reinterpret_cast<std::uint32_t*>(static_cast<char*>(ring) + offset);
+  }
+
+  void prep(std::uint8_t opcode, int fd, const void* address,
+            std::size_t length, std::uint64_t offset) {
+    std::memset(sqe_, 0, sizeof(io_uring_sqe));
+    sqe_->opcode = opcode;
+    sqe_->fd = fd;
+    sqe_->addr = reinterpret_cast<std::uint64_t>(address);
+    sqe_->len = static_cast<std::uint32_t>(length);
+    sqe_->off = offset;
+  }
+
+  int enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    const int result = static_cast<int>(syscall(
+        __NR_io_uring_enter, fd_, to_submit, min_complete, flags, nullptr, 0));
+    if (result < 0) return -errno;
+    num_unsubmitted_ -= static_cast<unsigned>(result);
+    return result;
+  }
+
+  int fd_ = -1;
+  int error_ = 0;
+
+  void* sq_ring_ = nullptr;
+  std::size_t sq_ring_size_ = 0;
+  std::uint32_t* sq_head_ = nullptr;
+  std::uint32_t* sq_tail_ = nullptr;
+  std::uint32_t sq_mask_ = 0;
+  std::uint32_t sq_entries_ = 0;
+  // The tail of the entries we committed.
+  std::uint32_t sq_local_tail_ = 0;
+  unsigned num_unsubmitted_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  std::size_t sqes_size_ = 0;
+  // The entry being filled.
+  io_uring_sqe* sqe_ = nullptr;
+  // Whether the last committed entry is linked to the next one.
+  bool linked_ = false;
+  // -errno of the full ring that dropped the end of the batch, or 0.
+  int dropped_error_ = 0;
+  // Where the entries of the dropped batch are filled (io_uring_sqe ends with
+  // a zero-size array, which can't be a member).
+  std::unique_ptr<io_uring_sqe> dropped_sqe_ = std::make_unique<io_uring_sqe>();
+
+  void* cq_ring_ = nullptr;
+  std::size_t cq_ring_size_ = 0;
+  std::uint32_t* cq_head_ = nullptr;
+  std::uint32_t* cq_tail_ = nullptr;
+  std::uint32_t cq_mask_ = 0;
+  io_uring_cqe* cqes_ = nullptr;
+};
+
+using IoUringInitialStates = prot_enc::InitialStates<IoUringSqeState::IDLE>;
+
+using IoUringTransitions = prot_enc::Transitions<
+    prot_enc::Transition<IoUringSqeState::IDLE, IoUringSqeState::ACQUIRED,
+                         &IoUring::get_sqe>,
+    prot_enc::Transition<IoUringSqeState::ACQUIRED, IoUringSqeState::PREPARED,
+                         &IoUring::prep_read>,
+    prot_enc::Transition<IoUringSqeState::ACQUIRED, IoUringSqeState::PREPARED,
+                         &IoUring::prep_write>,
+    prot_enc::Transition<IoUringSqeState::PREPARED, IoUringSqeState::PREPARED,
+                         &IoUring::set_flags>,
+    prot_enc::Transition<IoUringSqeState::PREPARED, IoUringSqeState::TAGGED,
+                         &IoUring::set_user_data>,
+    prot_enc::Transition<IoUringSqeState::TAGGED, IoUringSqeState::IDLE,
+                         &IoUring::commit>>;
+
+using IoUringFinalTransitions = prot_enc::FinalTransitions<
+    prot_enc::FinalTransition<IoUringSqeState::IDLE, &IoUring::submit>,
+    prot_enc::FinalTransition<IoUringSqeState::IDLE,
+                              &IoUring::submit_and_wait>>;
+
+using IoUringValidQueries = prot_enc::ValidQueries<>;
+
+using BorrowedIoUring = prot_enc::Borrowed<IoUring>;
+
+PROTENC_START_WRAPPER(IoUringSubmissionBuilder, BorrowedIoUring,
+                      IoUringSqeState, IoUringInitialStates,
+                      IoUringTransitions, IoUringFinalTransitions,
+                      IoUringValidQueries);
+
+  PROTENC_DECLARE_TRANSITION(get_sqe);
+  PROTENC_DECLARE_TRANSITION(prep_read);
+  PROTENC_DECLARE_TRANSITION(prep_write);
+  PROTENC_DECLARE_TRANSITION(set_flags);
+  PROTENC_DECLARE_TRANSITION(set_user_data);
+  PROTENC_DECLARE_TRANSITION(commit);
+
+  PROTENC_DECLARE_FINAL_TRANSITION(submit);
+  PROTENC_DECLARE_FINAL_TRANSITION(submit_and_wait);
+
+PROTENC_END_WRAPPER;
+
+// Fill a batch of entries of the ring, which must be set up. There must be one
+// batch at a time per ring.
+inline IoUringSubmissionBuilder<IoUringSqeState::IDLE> GetSubmissionBuilder(
+    IoUring& ring) {
+  assert(ring.error() == 0 && "The ring is not set up");
+  return IoUringSubmissionBuilder<IoUringSqeState::IDLE>::borrow(ring);
+}
+
+#endif // PROTENC_EXAMPLE_IO_URING_BATCH_H_
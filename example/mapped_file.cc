@@ -0,0 +1,50 @@
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <span>
+
+#include "mapped_file.h"
+
+// Example use of the memory-mapped file reader: count the lines of a file,
+// reading it in place.
+
+int main() {
+    char path[] = "/tmp/protenc_mapped_XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd < 0) {
+      std::cerr << "Could not create a temporary file\n";
+      return 1;
+    }
+    close(fd);
+    {
+      std::ofstream file(path);
+      for (int i = 0; i < 100000; ++i) file << "line " << i << "\n";
+    }
+
+    auto mapped = GetMappedFile().open(path).map().advise(MADV_SEQUENTIAL);
+    // Does not compile: the file must be mapped to be read.
+    // GetMappedFile().open(path).view();
+    std::span<const std::byte> data = mapped.view();
+    const auto lines = std::count(data.begin(), data.end(), std::byte{'\n'});
+    std::span<const std::byte> first_line = mapped.read_view(0, 7);
+    std::cout << "First line: ";
+    std::cout.write(reinterpret_cast<const char*>(first_line.data()),
+                    first_line.size());
+    std::cout << mapped.size() << " bytes, " << lines << " lines\n";
+
+    // Does not compile: the file is still mapped.
+    // std::move(mapped).close();
+    const int error = std::move(mapped).unmap().close();
+    unlink(path);
+    if (error != 0) {
+      std::cerr << "Error: " << std::strerror(error) << "\n";
+      return 1;
+    }
+    return lines == 100000 ? 0 : 1;
+}
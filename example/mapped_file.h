@@ -0,0 +1,189 @@
+#ifndef PROTENC_EXAMPLE_MAPPED_FILE_H_
+#define PROTENC_EXAMPLE_MAPPED_FILE_H_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <span>
+#include <utility>
+
+#include "protenc.h"
+
+// Example use of the ProtEnc library: reading a file through a memory mapping.
+//
+// The protocol is:
+//
+//  ********           ******          ********
+//  *CLOSED* --open--> *OPEN* --map--> *MAPPED*
+//  ********           ******          ********
+//                     |  ^              |  ^
+//                     |  |              |  |
+//                     |  ---unmap--------  advise
+//                     |
+//                     -->close<--
+//
+// The views of the file (read_view) can only be taken in the MAPPED state, and
+// the syscalls can only be made in order: no mmap() of a closed file, no
+// madvise() of an unmapped one, no close() of a mapped one. A view must still
+// not be used after the unmap.
+//
+// The errors of the syscalls don't change the state: they are recorded, the
+// next syscalls are skipped, and the views are empty. error() gives the errno
+// of the first error.
+
+enum class MappedFileState {
+  CLOSED,
+  // The file is open, not mapped.
+  OPEN,
+  MAPPED,
+};
+
+template <MappedFileState>
+class MappedFileWrapper;
+
+class MappedFile {
+ public:
+  void open(const char* path) {
+    fd_ = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) return fail();
+    struct stat status;
+    if (fstat(fd_, &status) != 0) return fail();
+    size_ = static_cast<std::size_t>(status.st_size);
+  }
+
+  // Map the whole file, read-only.
+  void map() {
+    // mmap() refuses empty mappings.
+    if (error_ != 0 || size_ == 0) return;
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (data == MAP_FAILED) return fail();
+    data_ = static_cast<const std::byte*>(data);
+  }
+
+  // Tell the kernel how the mapping will be read, e.g. MADV_SEQUENTIAL,
+  // MADV_WILLNEED.
+  void advise(int advice) {
+    if (data_ == nullptr) return;
+    if (madvise(const_cast<std::byte*>(data_), size_, advice) != 0) fail();
+  }
+
+  // The bytes [offset, offset + size) of the file, clamped to its end. It
+  // points into the mapping: no copy.
+  std::span<const std::byte> read_view(std::size_t offset,
+                                       std::size_t size) const {
+    if (data_ == nullptr || offset >= size_) return {};
+    return std::span<const std::byte>(data_ + offset,
+                                      size < size_ - offset ? size
+                                                            : size_ - offset);
+  }
+
+  // The whole file.
+  std::span<const std::byte> view() const { return read_view(0, size_); }
+
+  void unmap() {
+    if (data_ != nullptr && munmap(const_cast<std::byte*>(data_), size_) != 0) {
+      fail();
+    }
+    data_ = nullptr;
+  }
+
+  // Close the file. Returns the errno of the first error, or 0.
+  int close() && {
+    if (fd_ >= 0 && ::close(fd_) != 0) fail();
+    fd_ = -1;
+    return error_;
+  }
+
+  std::size_t size() const { return size_; }
+
+  int error() const { return error_; }
+
+  // In case the protocol was not followed to the end.
+  ~MappedFile() {
+    if (data_ != nullptr) munmap(const_cast<std::byte*>(data_), size_);
+    if (fd_ >= 0) ::close(fd_);
+  }
+
+  MappedFile(MappedFile&& other)
+      : fd_(other.fd_),
+        data_(other.data_),
+        size_(other.size_),
+        error_(other.error_) {
+    other.fd_ = -1;
+    other.data_ = nullptr;
+  }
+
+  // Swaps the objects: other releases the file and the mapping of this object.
+  MappedFile& operator=(MappedFile&& other) {
+    std::swap(fd_, other.fd_);
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    std::swap(error_, other.error_);
+    return *this;
+  }
+
+ private:
+  MappedFile() = default;
+
+  template <MappedFileState>
+  friend class ::MappedFileWrapper;
+
+  void fail() {
+    if (error_ == 0) error_ = errno;
+  }
+
+  int fd_ = -1;
+  const std::byte* data_ = nullptr;
+  std::size_t size_ = 0;
+  int error_ = 0;
+};
+
+using MappedFileInitialStates =
+    prot_enc::InitialStates<MappedFileState::CLOSED>;
+
+using MappedFileTransitions = prot_enc::Transitions<
+    prot_enc::Transition<MappedFileState::CLOSED, MappedFileState::OPEN,
+                         &MappedFile::open>,
+    prot_enc::Transition<MappedFileState::OPEN, MappedFileState::MAPPED,
+                         &MappedFile::map>,
+    prot_enc::Transition<MappedFileState::MAPPED, MappedFileState::MAPPED,
+                         &MappedFile::advise>,
+    prot_enc::Transition<MappedFileState::MAPPED, MappedFileState::OPEN,
+                         &MappedFile::unmap>>;
+
+using MappedFileFinalTransitions = prot_enc::FinalTransitions<
+    prot_enc::FinalTransition<MappedFileState::OPEN, &MappedFile::close>>;
+
+using MappedFileValidQueries = prot_enc::ValidQueries<
+    prot_enc::ValidQuery<MappedFileState::MAPPED, &MappedFile::read_view>,
+    prot_enc::ValidQuery<MappedFileState::MAPPED, &MappedFile::view>,
+    prot_enc::ValidQuery<MappedFileState::OPEN, &MappedFile::size>,
+    prot_enc::ValidQuery<MappedFileState::MAPPED, &MappedFile::size>,
+    prot_enc::ValidQuery<MappedFileState::OPEN, &MappedFile::error>,
+    prot_enc::ValidQuery<MappedFileState::MAPPED, &MappedFile::error>>;
+
+PROTENC_START_WRAPPER(MappedFileWrapper, MappedFile, MappedFileState,
+                      MappedFileInitialStates, MappedFileTransitions,
+                      MappedFileFinalTransitions, MappedFileValidQueries);
+
+  PROTENC_DECLARE_TRANSITION(open);
+  PROTENC_DECLARE_TRANSITION(map);
+  PROTENC_DECLARE_TRANSITION(advise);
+  PROTENC_DECLARE_TRANSITION(unmap);
+
+  PROTENC_DECLARE_FINAL_TRANSITION(close);
+
+  PROTENC_DECLARE_QUERY_METHOD(read_view);
+  PROTENC_DECLARE_QUERY_METHOD(view);
+  PROTENC_DECLARE_QUERY_METHOD(size);
+  PROTENC_DECLARE_QUERY_METHOD(error);
+
+PROTENC_END_WRAPPER;
+
+inline MappedFileWrapper<MappedFileState::CLOSED> GetMappedFile() { return {}; }
+
+#endif // PROTENC_EXAMPLE_MAPPED_FILE_H_
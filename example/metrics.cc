@@ -0,0 +1,78 @@
+#include <unistd.h>
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "protenc.h"
+#include "protenc_metrics.h"
+
+// Example use of the MetricsPolicy: jobs run by several threads, whose
+// transitions are counted and timed, then exported in the OpenMetrics format.
+
+enum class JobState { QUEUED, RUNNING, DONE };
+
+template <JobState>
+class JobWrapper;
+
+class Job {
+ public:
+  void start(int worker) { worker_ = worker; }
+
+  // Some work.
+  void step() {
+    for (int i = 0; i < 100; ++i) checksum_ = checksum_ * 31 + i;
+  }
+
+  void finish() { done_ = true; }
+
+  std::uint64_t report() && { return checksum_ + worker_; }
+
+ private:
+  Job() = default;
+
+  template <JobState>
+  friend class ::JobWrapper;
+
+  int worker_ = 0;
+  std::uint64_t checksum_ = 0;
+  bool done_ = false;
+};
+
+using prot_enc::FinalTransition;
+using prot_enc::Transition;
+
+using JobInitialStates = prot_enc::InitialStates<JobState::QUEUED>;
+using JobTransitions = prot_enc::Transitions<
+    Transition<JobState::QUEUED, JobState::RUNNING, &Job::start>,
+    Transition<JobState::RUNNING, JobState::RUNNING, &Job::step>,
+    Transition<JobState::RUNNING, JobState::DONE, &Job::finish>>;
+using JobFinalTransitions = prot_enc::FinalTransitions<
+    FinalTransition<JobState::DONE, &Job::report>>;
+using JobValidQueries = prot_enc::ValidQueries<>;
+
+PROTENC_START_WRAPPER_WITH_POLICY(JobWrapper, Job, JobState, JobInitialStates,
+                                  JobTransitions, JobFinalTransitions,
+                                  JobValidQueries, prot_enc::MetricsPolicy);
+  PROTENC_DECLARE_TRANSITION(start);
+  PROTENC_DECLARE_TRANSITION(step);
+  PROTENC_DECLARE_TRANSITION(finish);
+  PROTENC_DECLARE_FINAL_TRANSITION(report);
+PROTENC_END_WRAPPER;
+
+int main() {
+    std::vector<std::thread> workers;
+    std::vector<std::uint64_t> checksums(4);
+    for (int worker = 0; worker < 4; ++worker) {
+      workers.emplace_back([worker, &checksums] {
+        for (int i = 0; i < 1000; ++i) {
+          auto job = JobWrapper<JobState::QUEUED>().start(worker);
+          for (int j = 0; j < i % 4; ++j) job = std::move(job).step();
+          checksums[worker] += std::move(job).finish().report();
+        }
+      });
+    }
+    for (std::thread& worker : workers) worker.join();
+    // The counts of the workers are kept after they exit.
+    return prot_enc::WriteOpenMetrics(STDOUT_FILENO) ? 0 : 1;
+}
@@ -0,0 +1,43 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+#include "order_record.h"
+
+// Example use of the fixed-layout record builder: write orders into a buffer
+// of records, and read them back.
+
+int main() {
+    std::vector<OrderRecord> records;
+    for (std::uint32_t i = 0; i < 4; ++i) {
+      records.push_back(GetOrderRecordBuilder()
+                            .id(1000 + i)
+                            .symbol("ACME")
+                            .price(1234500 + i)
+                            .quantity(100 * (i + 1))
+                            .side(i % 2 == 0 ? Side::BUY : Side::SELL)
+                            .finish());
+    }
+    // Does not compile: the fields are written in order.
+    // GetOrderRecordBuilder().id(1).price(2);
+    // Does not compile: the side is missing.
+    // GetOrderRecordBuilder().id(1).symbol("A").price(2).quantity(3).finish();
+
+    std::cout << "Records of " << sizeof(OrderRecord) << " bytes\n";
+    for (const OrderRecord& record : records) {
+      const auto symbol = ReadOrderField<OrderField::SYMBOL>(record);
+      std::cout << "#" << ReadOrderField<OrderField::ID>(record) << " "
+                << (ReadOrderField<OrderField::SIDE>(record) == Side::BUY
+                        ? "BUY "
+                        : "SELL ")
+                << ReadOrderField<OrderField::QUANTITY>(record) << " "
+                << std::string_view(symbol.data(),
+                                    strnlen(symbol.data(), symbol.size()))
+                << " at "
+                << ReadOrderField<OrderField::PRICE>(record) / 1e4 << "\n";
+    }
+    return ReadOrderField<OrderField::QUANTITY>(records[3]) == 400 ? 0 : 1;
+}
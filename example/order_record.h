@@ -0,0 +1,216 @@
+#ifndef PROTENC_EXAMPLE_ORDER_RECORD_H_
+#define PROTENC_EXAMPLE_ORDER_RECORD_H_
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+#include "protenc.h"
+
+// Example use of the ProtEnc library: a binary record with a fixed layout.
+//
+// The protocol writes the fields of the record in order:
+//
+//  ****       ********           *******          **********
+//  *ID* -id-> *SYMBOL* -symbol-> *PRICE* -price-> *QUANTITY* --
+//  ****       ********           *******          **********   |
+//                                                              quantity
+//                 ******         ******                        |
+//    finish<--    *DONE* <-side- *SIDE* <-----------------------
+//                 ******         ******
+//
+// Since the order is fixed, the offset of every field is a compile-time
+// constant, and the record has no length prefixes, offset table or presence
+// bits: it is just the fields, packed, the scalars in little-endian order.
+// Each transition is a store at a constant offset, and the record is read
+// back at the same offsets, like a flatbuffer struct.
+
+template <typename T>
+struct is_byte_array : std::false_type {};
+
+template <typename T, std::size_t N>
+struct is_byte_array<std::array<T, N>>
+    : std::bool_constant<sizeof(T) == 1> {};
+
+// The layout of a record of packed trivially copyable fields.
+template <typename... Fields>
+struct RecordLayout {
+  static_assert((std::is_trivially_copyable_v<Fields> && ...),
+                "The fields are copied as bytes");
+  // Only the scalars are byte-swapped on big-endian hosts: the arrays of
+  // bytes (e.g. std::array<char, 8>) are kept in order.
+  static_assert(((std::is_scalar_v<Fields> || is_byte_array<Fields>::value) &&
+                 ...),
+                "The fields are scalars or arrays of bytes");
+
+  using FieldTypes = std::tuple<Fields...>;
+  template <std::size_t I>
+  using Field = std::tuple_element_t<I, FieldTypes>;
+
+  // offsets[I] is the offset of the field I; offsets[sizeof...(Fields)] is
+  // the size of the record.
+  static constexpr std::array<std::size_t, sizeof...(Fields) + 1> offsets =
+      [] {
+        std::array<std::size_t, sizeof...(Fields) + 1> result{};
+        const std::size_t sizes[] = {sizeof(Fields)...};
+        for (std::size_t i = 0; i < sizeof...(Fields); ++i) {
+          result[i + 1] = result[i] + sizes[i];
+        }
+        return result;
+      }();
+
+  static constexpr std::size_t size = offsets.back();
+
+  using Bytes = std::array<std::byte, size>;
+
+  template <std::size_t I>
+  static void store(Bytes& bytes, const Field<I>& value) {
+    std::byte* destination = bytes.data() + offsets[I];
+    std::memcpy(destination, &value, sizeof(value));
+    if constexpr (std::endian::native == std::endian::big &&
+                  std::is_scalar_v<Field<I>>) {
+      std::reverse(destination, destination + sizeof(value));
+    }
+  }
+
+  template <std::size_t I>
+  static Field<I> load(std::span<const std::byte, size> bytes) {
+    std::array<std::byte, sizeof(Field<I>)> field;
+    std::memcpy(field.data(), bytes.data() + offsets[I], sizeof(field));
+    if constexpr (std::endian::native == std::endian::big &&
+                  std::is_scalar_v<Field<I>>) {
+      std::reverse(field.begin(), field.end());
+    }
+    return std::bit_cast<Field<I>>(field);
+  }
+};
+
+// The state is the field to write next, and its value is the index of the
+// field (checked against the protocol below).
+enum class OrderField { ID, SYMBOL, PRICE, QUANTITY, SIDE, DONE };
+
+enum class Side : std::uint8_t { BUY, SELL };
+
+using OrderLayout =
+    RecordLayout<std::uint64_t, std::array<char, 8>, std::int64_t,
+                 std::uint32_t, Side>;
+
+static_assert(OrderLayout::offsets[static_cast<std::size_t>(
+                  OrderField::QUANTITY)] == 24);
+static_assert(OrderLayout::size == 29);
+
+using OrderRecord = OrderLayout::Bytes;
+
+template <OrderField>
+class OrderRecordBuilderWrapper;
+
+class OrderRecordBuilder {
+ public:
+  void id(std::uint64_t id) { store<OrderField::ID>(id); }
+
+  // Up to 8 characters, padded with '\0'.
+  void symbol(std::string_view symbol) {
+    std::array<char, 8> padded{};
+    symbol.copy(padded.data(), padded.size());
+    store<OrderField::SYMBOL>(padded);
+  }
+
+  // In ten-thousandths.
+  void price(std::int64_t price) { store<OrderField::PRICE>(price); }
+
+  void quantity(std::uint32_t quantity) {
+    store<OrderField::QUANTITY>(quantity);
+  }
+
+  void side(Side side) { store<OrderField::SIDE>(side); }
+
+  OrderRecord finish() && { return record_; }
+
+ private:
+  OrderRecordBuilder() = default;
+
+  template <OrderField>
+  friend class ::OrderRecordBuilderWrapper;
+
+  template <OrderField F, typename T>
+  void store(const T& value) {
+    constexpr std::size_t index = static_cast<std::size_t>(F);
+    static_assert(std::is_same_v<T, OrderLayout::Field<index>>,
+                  "The value has the type of the field");
+    OrderLayout::store<index>(record_, value);
+  }
+
+  // Every byte is written by the transitions.
+  OrderRecord record_;
+};
+
+using OrderInitialStates = prot_enc::InitialStates<OrderField::ID>;
+
+using OrderTransitions = prot_enc::Transitions<
+    prot_enc::Transition<OrderField::ID, OrderField::SYMBOL,
+                         &OrderRecordBuilder::id>,
+    prot_enc::Transition<OrderField::SYMBOL, OrderField::PRICE,
+                         &OrderRecordBuilder::symbol>,
+    prot_enc::Transition<OrderField::PRICE, OrderField::QUANTITY,
+                         &OrderRecordBuilder::price>,
+    prot_enc::Transition<OrderField::QUANTITY, OrderField::SIDE,
+                         &OrderRecordBuilder::quantity>,
+    prot_enc::Transition<OrderField::SIDE, OrderField::DONE,
+                         &OrderRecordBuilder::side>>;
+
+// Whether the transitions write the fields in the order of the layout: the
+// transition I goes from the field I to the field I + 1, so that the value of
+// a state is the number of transitions from the initial state.
+template <auto... Starts, auto... Ends, auto... Functions>
+constexpr bool WritesFieldsInOrder(
+    prot_enc::Transitions<
+        prot_enc::Transition<Starts, Ends, Functions>...>*) {
+  const std::size_t starts[] = {static_cast<std::size_t>(Starts)...};
+  const std::size_t ends[] = {static_cast<std::size_t>(Ends)...};
+  for (std::size_t i = 0; i < sizeof...(Starts); ++i) {
+    if (starts[i] != i || ends[i] != i + 1) return false;
+  }
+  return sizeof...(Starts) == std::tuple_size_v<OrderLayout::FieldTypes>;
+}
+
+static_assert(static_cast<std::size_t>(OrderField::ID) == 0 &&
+                  WritesFieldsInOrder(static_cast<OrderTransitions*>(nullptr)),
+              "The protocol writes the fields in the order of the layout");
+
+using OrderFinalTransitions = prot_enc::FinalTransitions<
+    prot_enc::FinalTransition<OrderField::DONE, &OrderRecordBuilder::finish>>;
+
+using OrderValidQueries = prot_enc::ValidQueries<>;
+
+PROTENC_START_WRAPPER(OrderRecordBuilderWrapper, OrderRecordBuilder,
+                      OrderField, OrderInitialStates, OrderTransitions,
+                      OrderFinalTransitions, OrderValidQueries);
+
+  PROTENC_DECLARE_TRANSITION(id);
+  PROTENC_DECLARE_TRANSITION(symbol);
+  PROTENC_DECLARE_TRANSITION(price);
+  PROTENC_DECLARE_TRANSITION(quantity);
+  PROTENC_DECLARE_TRANSITION(side);
+
+  PROTENC_DECLARE_FINAL_TRANSITION(finish);
+
+PROTENC_END_WRAPPER;
+
+inline OrderRecordBuilderWrapper<OrderField::ID> GetOrderRecordBuilder() {
+  return {};
+}
+
+// Read a field of a record.
+template <OrderField F>
+auto ReadOrderField(std::span<const std::byte, OrderLayout::size> record) {
+  return OrderLayout::load<static_cast<std::size_t>(F)>(record);
+}
+
+#endif // PROTENC_EXAMPLE_ORDER_RECORD_H_
@@ -0,0 +1,86 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "protenc.h"
+#include "protenc_recycling.h"
+
+// Example use of the RecyclingPolicy: a request builder whose buffers are
+// reused from one request to the next.
+
+enum class RequestState { START, HEADERS, DONE };
+
+template <RequestState>
+class RequestBuilderWrapper;
+
+class RequestBuilder {
+ public:
+  void add_header(std::string header) {
+    headers_.push_back(std::move(header));
+  }
+
+  // The request, serialized. The headers stay in the builder, so that their
+  // buffers can be reused.
+  std::string build() && {
+    std::string result;
+    for (const std::string& header : headers_) {
+      result += header;
+      result += "\r\n";
+    }
+    return result;
+  }
+
+  std::size_t capacity() const { return headers_.capacity(); }
+
+  // Called before reusing the object: clear it, but keep its capacity.
+  void reset() { headers_.clear(); }
+
+ private:
+  RequestBuilder() = default;
+
+  template <RequestState>
+  friend class ::RequestBuilderWrapper;
+
+  std::vector<std::string> headers_;
+};
+
+using prot_enc::FinalTransition;
+using prot_enc::Transition;
+using prot_enc::ValidQuery;
+
+using RequestInitialStates = prot_enc::InitialStates<RequestState::START>;
+using RequestTransitions = prot_enc::Transitions<
+    Transition<RequestState::START, RequestState::HEADERS,
+               &RequestBuilder::add_header>,
+    Transition<RequestState::HEADERS, RequestState::HEADERS,
+               &RequestBuilder::add_header>>;
+using RequestFinalTransitions = prot_enc::FinalTransitions<
+    FinalTransition<RequestState::HEADERS, &RequestBuilder::build>>;
+using RequestValidQueries = prot_enc::ValidQueries<
+    ValidQuery<RequestState::START, &RequestBuilder::capacity>>;
+
+PROTENC_START_WRAPPER_WITH_POLICY(RequestBuilderWrapper, RequestBuilder,
+                                  RequestState, RequestInitialStates,
+                                  RequestTransitions, RequestFinalTransitions,
+                                  RequestValidQueries,
+                                  prot_enc::RecyclingPolicy<>);
+  PROTENC_DECLARE_TRANSITION(add_header);
+  PROTENC_DECLARE_FINAL_TRANSITION(build);
+  PROTENC_DECLARE_QUERY_METHOD(capacity);
+PROTENC_END_WRAPPER;
+
+int main() {
+    for (int i = 0; i < 3; ++i) {
+      RequestBuilderWrapper<RequestState::START> builder;
+      // The first builder starts empty, the next ones reuse its buffers.
+      std::cout << "Request " << i << ": capacity " << builder.capacity()
+                << "\n";
+      std::string request = std::move(builder)
+                                .add_header("Host: example.com")
+                                .add_header("Accept: */*")
+                                .add_header("Connection: close")
+                                .build();
+      std::cout << request;
+    }
+    return 0;
+}
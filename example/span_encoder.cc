@@ -0,0 +1,87 @@
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include "span_encoder.h"
+
+// Example use of the span encoder: encode a span, and decode it back field by
+// field.
+
+namespace {
+
+std::uint64_t ReadVarint(std::string_view& input) {
+  std::uint64_t value = 0;
+  for (int shift = 0; !input.empty(); shift += 7) {
+    const auto byte = static_cast<std::uint8_t>(input.front());
+    input.remove_prefix(1);
+    value |= std::uint64_t{byte & 0x7fu} << shift;
+    if (byte < 0x80) break;
+  }
+  return value;
+}
+
+// Print the fields of the message, indented, and return whether it is
+// well-formed.
+bool Print(std::string_view message, const std::string& indent) {
+  while (!message.empty()) {
+    const std::uint64_t tag = ReadVarint(message);
+    std::cout << indent << "field " << (tag >> 3) << ": ";
+    switch (static_cast<wire::WireType>(tag & 7)) {
+      case wire::WireType::VARINT:
+        std::cout << ReadVarint(message) << "\n";
+        break;
+      case wire::WireType::FIXED64: {
+        if (message.size() < 8) return false;
+        std::uint64_t value = 0;
+        for (int i = 7; i >= 0; --i) {
+          value = value << 8 | static_cast<std::uint8_t>(message[i]);
+        }
+        message.remove_prefix(8);
+        std::cout << std::hex << value << std::dec << "\n";
+        break;
+      }
+      case wire::WireType::LENGTH_DELIMITED: {
+        const std::uint64_t size = ReadVarint(message);
+        if (size > message.size()) return false;
+        const std::string_view content = message.substr(0, size);
+        message.remove_prefix(size);
+        // The attributes are nested messages.
+        if ((tag >> 3) == 6) {
+          std::cout << "{\n";
+          if (!Print(content, indent + "  ")) return false;
+          std::cout << indent << "}\n";
+        } else {
+          std::cout << '"' << content << "\"\n";
+        }
+        break;
+      }
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+int main() {
+    auto encoder = GetSpanEncoder()
+                       .trace_id(0x5b8efff798038103)
+                       .span_id(42)
+                       .name("GET /api/items")
+                       .start_time(1559390400000000000)
+                       .duration(1250000)
+                       .attribute("http.method", "GET");
+    encoder = std::move(encoder).attribute("http.status_code", "200");
+    // Does not compile: the name is missing.
+    // GetSpanEncoder().trace_id(1).span_id(2).start_time(3).encode();
+    // Does not compile: the duration comes before the attributes.
+    // std::move(encoder).duration(4);
+    const std::size_t size = encoder.encoded_size();
+    const std::string message = std::move(encoder).encode();
+    std::cout << "Encoded " << message.size() << " bytes (announced " << size
+              << "):\n";
+    return Print(message, "  ") && message.size() == size ? 0 : 1;
+}
@@ -0,0 +1,295 @@
+#ifndef PROTENC_EXAMPLE_SPAN_ENCODER_H_
+#define PROTENC_EXAMPLE_SPAN_ENCODER_H_
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "protenc.h"
+#include "protenc_recycling.h"
+
+// Example use of the ProtEnc library: an encoder of protobuf-like messages,
+// with varints and length-delimited (TLV) fields.
+//
+// The message is:
+//   message Span {
+//     fixed64 trace_id = 1;
+//     uint64 span_id = 2;
+//     string name = 3;
+//     uint64 start_time_ns = 4;
+//     uint64 duration_ns = 5;  // Optional.
+//     repeated Attribute attributes = 6;
+//   }
+//   message Attribute {
+//     string key = 1;
+//     string value = 2;
+//   }
+//
+// and the protocol writes its fields in order:
+//
+//  **********              *********              ******
+//  *TRACE_ID* --trace_id-> *SPAN_ID* --span_id--> *NAME* --name--
+//  **********              *********              ******         |
+//                                                                |
+//         *******                  ************                  |
+//         *TIMED* <--start_time--- *START_TIME* <-----------------
+//         *******                  ************
+//          |   |                                 attribute
+//          |   |                                   |  ^
+//          |   ---duration-------> ************    |  |
+//          |                       *ATTRIBUTES* ----  |
+//          ----attribute---------> ************ ------
+//          |                            |
+//          -->encode<--        -->encode<--
+//
+// Each transition adds the encoded size of its field: the size of the tag is
+// a compile-time constant, only the varints and strings are measured at
+// runtime. The encoder then knows the size of every field, including the
+// nested attributes, before writing anything: encode() allocates the message
+// once and writes it in a single pass, with no length prefix to patch
+// afterwards.
+//
+// The strings are copied into a buffer that, with the encoder, is recycled
+// from one message to the next: in steady state, encoding a message only
+// allocates the message itself.
+
+namespace wire {
+
+enum class WireType : std::uint8_t {
+  VARINT = 0,
+  FIXED64 = 1,
+  LENGTH_DELIMITED = 2,
+};
+
+constexpr std::size_t varint_size(std::uint64_t value) {
+  // 7 bits per byte, and at least one byte.
+  return (std::bit_width(value | 1) + 6) / 7;
+}
+
+template <std::uint32_t Field, WireType Type>
+constexpr std::uint64_t tag =
+    (std::uint64_t{Field} << 3) | static_cast<std::uint8_t>(Type);
+
+template <std::uint32_t Field, WireType Type>
+constexpr std::size_t tag_size = varint_size(tag<Field, Type>);
+
+// Size of a length-delimited field whose content has the given size.
+template <std::uint32_t Field>
+constexpr std::size_t length_delimited_size(std::size_t size) {
+  return tag_size<Field, WireType::LENGTH_DELIMITED> + varint_size(size) +
+         size;
+}
+
+inline char* write_varint(char* output, std::uint64_t value) {
+  for (; value >= 0x80; value >>= 7) {
+    *output++ = static_cast<char>(value | 0x80);
+  }
+  *output++ = static_cast<char>(value);
+  return output;
+}
+
+inline char* write_fixed64(char* output, std::uint64_t value) {
+  for (int i = 0; i < 8; ++i, value >>= 8) {
+    *output++ = static_cast<char>(value & 0xff);
+  }
+  return output;
+}
+
+template <std::uint32_t Field, WireType Type>
+char* write_tag(char* output) {
+  return write_varint(output, tag<Field, Type>);
+}
+
+template <std::uint32_t Field>
+char* write_varint_field(char* output, std::uint64_t value) {
+  return write_varint(write_tag<Field, WireType::VARINT>(output), value);
+}
+
+template <std::uint32_t Field>
+char* write_string_field(char* output, std::string_view text) {
+  output = write_tag<Field, WireType::LENGTH_DELIMITED>(output);
+  output = write_varint(output, text.size());
+  return std::copy(text.begin(), text.end(), output);
+}
+
+} // namespace wire
+
+enum class SpanField {
+  TRACE_ID,
+  SPAN_ID,
+  NAME,
+  START_TIME,
+  // The mandatory fields are set.
+  TIMED,
+  // Adding attributes.
+  ATTRIBUTES,
+};
+
+template <SpanField>
+class SpanEncoderWrapper;
+
+class SpanEncoder {
+ public:
+  void trace_id(std::uint64_t trace_id) {
+    trace_id_ = trace_id;
+    size_ += wire::tag_size<1, wire::WireType::FIXED64> + 8;
+  }
+
+  void span_id(std::uint64_t span_id) {
+    span_id_ = span_id;
+    size_ += wire::tag_size<2, wire::WireType::VARINT> +
+             wire::varint_size(span_id);
+  }
+
+  void name(std::string_view name) {
+    name_ = append_text(name);
+    size_ += wire::length_delimited_size<3>(name.size());
+  }
+
+  void start_time(std::uint64_t start_time_ns) {
+    start_time_ = start_time_ns;
+    size_ += wire::tag_size<4, wire::WireType::VARINT> +
+             wire::varint_size(start_time_ns);
+  }
+
+  void duration(std::uint64_t duration_ns) {
+    duration_ = duration_ns;
+    has_duration_ = true;
+    size_ += wire::tag_size<5, wire::WireType::VARINT> +
+             wire::varint_size(duration_ns);
+  }
+
+  void attribute(std::string_view key, std::string_view value) {
+    const std::size_t size = wire::length_delimited_size<1>(key.size()) +
+                             wire::length_delimited_size<2>(value.size());
+    attributes_.push_back(
+        Attribute{append_text(key), append_text(value),
+                  static_cast<std::uint32_t>(size)});
+    size_ += wire::length_delimited_size<6>(size);
+  }
+
+  // Size of the encoded message.
+  std::size_t encoded_size() const { return size_; }
+
+  std::string encode() && {
+    std::string message(size_, '\0');
+    char* output = message.data();
+    output = wire::write_tag<1, wire::WireType::FIXED64>(output);
+    output = wire::write_fixed64(output, trace_id_);
+    output = wire::write_varint_field<2>(output, span_id_);
+    output = wire::write_string_field<3>(output, text(name_));
+    output = wire::write_varint_field<4>(output, start_time_);
+    if (has_duration_) output = wire::write_varint_field<5>(output, duration_);
+    for (const Attribute& attribute : attributes_) {
+      output = wire::write_tag<6, wire::WireType::LENGTH_DELIMITED>(output);
+      output = wire::write_varint(output, attribute.size);
+      output = wire::write_string_field<1>(output, text(attribute.key));
+      output = wire::write_string_field<2>(output, text(attribute.value));
+    }
+    assert(output == message.data() + message.size());
+    return message;
+  }
+
+  // Back to TRACE_ID, keeping the buffers (see RecyclingPolicy).
+  void reset() {
+    text_.clear();
+    attributes_.clear();
+    has_duration_ = false;
+    size_ = 0;
+  }
+
+ private:
+  SpanEncoder() = default;
+
+  template <SpanField>
+  friend class ::SpanEncoderWrapper;
+
+  // Part of text_.
+  struct Text {
+    std::uint32_t offset;
+    std::uint32_t size;
+  };
+
+  struct Attribute {
+    Text key;
+    Text value;
+    // Size of the nested message.
+    std::uint32_t size;
+  };
+
+  Text append_text(std::string_view text) {
+    const Text result{static_cast<std::uint32_t>(text_.size()),
+                      static_cast<std::uint32_t>(text.size())};
+    text_.append(text);
+    return result;
+  }
+
+  std::string_view text(Text part) const {
+    return std::string_view(text_).substr(part.offset, part.size);
+  }
+
+  std::uint64_t trace_id_ = 0;
+  std::uint64_t span_id_ = 0;
+  std::uint64_t start_time_ = 0;
+  std::uint64_t duration_ = 0;
+  bool has_duration_ = false;
+  Text name_{};
+  std::vector<Attribute> attributes_;
+  // The name, keys and values.
+  std::string text_;
+  // Encoded size of the fields so far.
+  std::size_t size_ = 0;
+};
+
+using SpanInitialStates = prot_enc::InitialStates<SpanField::TRACE_ID>;
+
+using SpanTransitions = prot_enc::Transitions<
+    prot_enc::Transition<SpanField::TRACE_ID, SpanField::SPAN_ID,
+                         &SpanEncoder::trace_id>,
+    prot_enc::Transition<SpanField::SPAN_ID, SpanField::NAME,
+                         &SpanEncoder::span_id>,
+    prot_enc::Transition<SpanField::NAME, SpanField::START_TIME,
+                         &SpanEncoder::name>,
+    prot_enc::Transition<SpanField::START_TIME, SpanField::TIMED,
+                         &SpanEncoder::start_time>,
+    prot_enc::Transition<SpanField::TIMED, SpanField::ATTRIBUTES,
+                         &SpanEncoder::duration>,
+    prot_enc::Transition<SpanField::TIMED, SpanField::ATTRIBUTES,
+                         &SpanEncoder::attribute>,
+    prot_enc::Transition<SpanField::ATTRIBUTES, SpanField::ATTRIBUTES,
+                         &SpanEncoder::attribute>>;
+
+using SpanFinalTransitions = prot_enc::FinalTransitions<
+    prot_enc::FinalTransition<SpanField::TIMED, &SpanEncoder::encode>,
+    prot_enc::FinalTransition<SpanField::ATTRIBUTES, &SpanEncoder::encode>>;
+
+using SpanValidQueries = prot_enc::ValidQueries<
+    prot_enc::ValidQuery<SpanField::TIMED, &SpanEncoder::encoded_size>,
+    prot_enc::ValidQuery<SpanField::ATTRIBUTES, &SpanEncoder::encoded_size>>;
+
+PROTENC_START_WRAPPER_WITH_POLICY(SpanEncoderWrapper, SpanEncoder, SpanField,
+                                  SpanInitialStates, SpanTransitions,
+                                  SpanFinalTransitions, SpanValidQueries,
+                                  prot_enc::RecyclingPolicy<>);
+
+  PROTENC_DECLARE_TRANSITION(trace_id);
+  PROTENC_DECLARE_TRANSITION(span_id);
+  PROTENC_DECLARE_TRANSITION(name);
+  PROTENC_DECLARE_TRANSITION(start_time);
+  PROTENC_DECLARE_TRANSITION(duration);
+  PROTENC_DECLARE_TRANSITION(attribute);
+
+  PROTENC_DECLARE_FINAL_TRANSITION(encode);
+
+  PROTENC_DECLARE_QUERY_METHOD(encoded_size);
+
+PROTENC_END_WRAPPER;
+
+inline SpanEncoderWrapper<SpanField::TRACE_ID> GetSpanEncoder() { return {}; }
+
+#endif // PROTENC_EXAMPLE_SPAN_ENCODER_H_
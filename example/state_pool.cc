@@ -0,0 +1,58 @@
+#include <iostream>
+#include <string>
+
+#include "http_connection.h"
+#include "protenc_state_pool.h"
+
+// Example use of the StatePool: many HTTP connection builders, in different
+// states, stored in one contiguous bucket per state.
+
+using Pool =
+    prot_enc::StatePool<HTTPConnectionBuilderWrapper<HTTPBuilderState::START>>;
+
+int main() {
+    Pool pool;
+
+    // Fill the pool with builders in the START and HEADERS states.
+    for (int i = 0; i < 1000; ++i) {
+      if (i % 2 == 0) {
+        pool.insert(GetConnectionBuilder());
+      } else {
+        pool.insert(GetConnectionBuilder().add_header("Host: example.com"));
+      }
+    }
+
+    // All the builders in START get their first header, in a single loop over
+    // their bucket. They all move to the HEADERS bucket.
+    pool.transition_all<HTTPBuilderState::START,
+                        &HTTPConnectionBuilder::add_header>(
+        std::string("Host: example.org"));
+
+    // Every builder in HEADERS gets a body, and moves to the BODY bucket.
+    pool.for_each<HTTPBuilderState::HEADERS>([](auto builder) {
+      return std::move(builder).add_body("Body");
+    });
+
+    // Finally, build the connections: they leave the pool.
+    std::size_t num_connections = 0;
+    pool.for_each<HTTPBuilderState::BODY>([&](auto builder) {
+      HTTPConnection connection = std::move(builder).build();
+      num_connections += !std::get<1>(connection).empty();
+    });
+
+    std::cout << "Built " << num_connections << " connections, "
+              << pool.size() << " left in the pool\n";
+
+    // A handle goes stale when its object leaves the pool, even if the next
+    // object reuses its index.
+    const prot_enc::PoolHandle first = pool.insert(GetConnectionBuilder());
+    pool.erase(first);
+    const prot_enc::PoolHandle second = pool.insert(GetConnectionBuilder());
+    std::cout << "First handle in the pool: " << pool.contains(first)
+              << ", second: " << pool.contains(second) << "\n";
+
+    // This doesn't compile:
+    // pool.transition_all<HTTPBuilderState::START,
+    //                     &HTTPConnectionBuilder::add_body>("Body");
+    return pool.contains(first) ? 1 : 0;
+}
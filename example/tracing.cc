@@ -0,0 +1,115 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "protenc.h"
+#include "protenc_trace.h"
+
+// Example use of the TracePolicy: requests handled by two threads, each
+// traced as a span from its reception to its response. Open the trace in
+// https://ui.perfetto.dev or chrome://tracing. A second export only writes the
+// events traced since the first one.
+
+enum class RequestState { RECEIVED, PARSED, RESPONDED };
+
+template <RequestState>
+class RequestWrapper;
+
+class Request {
+ public:
+  void parse(std::string text) { text_ = std::move(text); }
+
+  // A query to the database, whose duration shows in the trace.
+  void query(int milliseconds) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+    ++num_queries_;
+  }
+
+  void render() {}
+
+  int respond() && { return num_queries_ > 0 ? 200 : 204; }
+
+ private:
+  Request() = default;
+
+  template <RequestState>
+  friend class ::RequestWrapper;
+
+  std::string text_;
+  int num_queries_ = 0;
+};
+
+using prot_enc::FinalTransition;
+using prot_enc::Transition;
+
+using RequestInitialStates = prot_enc::InitialStates<RequestState::RECEIVED>;
+using RequestTransitions = prot_enc::Transitions<
+    Transition<RequestState::RECEIVED, RequestState::PARSED, &Request::parse>,
+    Transition<RequestState::PARSED, RequestState::PARSED, &Request::query>,
+    Transition<RequestState::PARSED, RequestState::RESPONDED,
+               &Request::render>>;
+using RequestFinalTransitions = prot_enc::FinalTransitions<
+    FinalTransition<RequestState::RESPONDED, &Request::respond>>;
+using RequestValidQueries = prot_enc::ValidQueries<>;
+
+PROTENC_START_WRAPPER_WITH_POLICY(RequestWrapper, Request, RequestState,
+                                  RequestInitialStates, RequestTransitions,
+                                  RequestFinalTransitions, RequestValidQueries,
+                                  prot_enc::TracePolicy);
+  PROTENC_DECLARE_TRANSITION(parse);
+  PROTENC_DECLARE_TRANSITION(query);
+  PROTENC_DECLARE_TRANSITION(render);
+  PROTENC_DECLARE_FINAL_TRANSITION(respond);
+PROTENC_END_WRAPPER;
+
+int main() {
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < 2; ++thread) {
+      threads.emplace_back([thread] {
+        for (int i = 0; i < 5; ++i) {
+          auto request = RequestWrapper<RequestState::RECEIVED>().parse(
+              "GET /items/" + std::to_string(i));
+          for (int j = 0; j <= (i + thread) % 3; ++j) {
+            request = std::move(request).query(1 + j);
+          }
+          std::move(request).render().respond();
+        }
+      });
+    }
+    for (std::thread& thread : threads) thread.join();
+    {
+      // Dropped before its response: its span ends "abandoned_in" PARSED.
+      auto request = RequestWrapper<RequestState::RECEIVED>().parse("GET /");
+    }
+
+    const char path[] = "/tmp/protenc_trace.json";
+    if (!prot_enc::WriteChromeTrace(path)) {
+      std::cerr << "Could not write " << path << "\n";
+      return 1;
+    }
+    std::cout << "Wrote the trace to " << path << "\n";
+
+    // The next export only has the events traced since.
+    for (int i = 0; i < 1000; ++i) {
+      RequestWrapper<RequestState::RECEIVED>()
+          .parse("GET /")
+          .query(1)
+          .render()
+          .respond();
+    }
+    if (!prot_enc::WriteChromeTrace(path)) {
+      std::cerr << "Could not write " << path << "\n";
+      return 1;
+    }
+    std::ifstream trace(path);
+    std::size_t num_events = 0;
+    for (std::string line; std::getline(trace, line);) {
+      num_events += line.starts_with("{\"ph\"");
+    }
+    std::cout << "Wrote " << num_events << " new events\n";
+    return num_events == 5000 ? 0 : 1;
+}
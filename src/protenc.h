@@ -13,7 +13,16 @@
  * See the README.md for more on typestates and what they are used for.
  **/
 
+#ifndef PROTENC_H_
+#define PROTENC_H_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
 #include <utility>
+#include <variant>
 
 namespace prot_enc {
 
@@ -43,6 +52,196 @@ struct FinalTransitions;
 template <typename... ValidQuery>
 struct ValidQueries;
 
+// Annotations on a Transition or FinalTransition, telling how often it is
+// taken. Hot transitions are inlined and optimized for speed, cold ones (e.g.
+// error or teardown edges) are kept out of line, in a separate text section,
+// so that they don't bloat the hot loops:
+//   Transitions<
+//     Hot<Transition<SENDING, SENDING, &Upload::send>>,
+//     Cold<Transition<SENDING, FAILED, &Upload::fail>>
+//   >
+// See example/hot_cold.cc.
+template <typename Transition>
+struct Hot;
+template <typename Transition>
+struct Cold;
+
+// Storage of a wrapper that doesn't own its object, but points to an object
+// living elsewhere (in a slab, shared memory, an intrusive container, ...). Use
+// it as the wrapped type, and build the wrappers with `borrow`:
+//   PROTENC_START_WRAPPER(SocketWrapper, prot_enc::Borrowed<Socket>, ...);
+//   auto wrapper = SocketWrapper<SocketState::CLOSED>::borrow(sockets[i]);
+// The protocol is still written with the functions of the object
+// (&Socket::open, ...), and a transition only moves the pointer. The object
+// must outlive the wrappers.
+template <typename T>
+class Borrowed {
+ public:
+  using Object = T;
+
+  explicit Borrowed(T& object) : object_(&object) {}
+
+  T& get() { return *object_; }
+  const T& get() const { return *object_; }
+
+ private:
+  T* object_;
+};
+
+// Policy of a wrapper: hooks called by the wrapper around the life of its
+// object, e.g. to recycle the wrapped objects or to instrument the protocol.
+// The default policy does nothing; a policy inherits from it and hides the
+// hooks it needs (see PROTENC_START_WRAPPER_WITH_POLICY):
+//   struct MyPolicy : prot_enc::DefaultPolicy {
+//     template <typename Protocol, auto From, auto To, auto FunctionPointer,
+//               typename Slot, typename Call>
+//     static void on_transition(Slot& slot, Call&& call) { ...; call(); }
+//   };
+// Every hook gets the Protocol of the wrapper (see internal::Protocol) and the
+// Slot of the object.
+struct DefaultPolicy {
+  // Per-object data of the policy, stored in the wrapper and moved along with
+  // the object to the next state. It takes no space when it is empty. The
+  // tools that take the object out of its wrapper (StatePool, AnyState, ...)
+  // store it along with the object.
+  struct Slot {};
+
+  // Create the object of a default-constructed wrapper. make_new() returns a
+  // new Wrapped{}.
+  template <typename Protocol, typename MakeNew>
+  static typename Protocol::Wrapped make_wrapped(MakeNew&& make_new) {
+    return make_new();
+  }
+
+  // A wrapper was constructed in the initial state State.
+  template <typename Protocol, auto State, typename Slot>
+  static void on_construct(Slot&) {}
+
+  // Take the transition From -> To: call() calls the wrapped function.
+  template <typename Protocol, auto From, auto To, auto FunctionPointer,
+            typename Slot, typename Call>
+  static void on_transition(Slot&, Call&& call) {
+    call();
+  }
+
+  // Take the final transition from From: call() calls the wrapped function
+  // (which consumes `wrapped`), and its result is returned.
+  template <typename Protocol, auto From, auto FunctionPointer, typename Slot,
+            typename Call>
+  static decltype(auto) on_final_transition(Slot&,
+                                            typename Protocol::Wrapped&,
+                                            Call&& call) {
+    return call();
+  }
+
+  // A wrapper in the state State is destroyed. This includes the wrappers
+  // whose object moved to the next state, or was consumed by a final
+  // transition: the policy tells them apart with its Slot if it needs to.
+  template <typename Protocol, auto State, typename Slot>
+  static void on_destroy(Slot&) {}
+};
+
+// Policy combining several policies, e.g.:
+//   Policies<RecyclingPolicy<>, MetricsPolicy, DwellTimePolicy>
+// Its Slot holds the Slots of all of them. The hooks of the first policy wrap
+// the ones of the next: the first one's make_wrapped() decides whether to ask
+// the next for a new object, and its on_transition() calls the next one's,
+// which calls the wrapped function. The on_destroy() hooks are called in the
+// reverse order.
+template <typename... P>
+struct Policies {
+  // Inheriting from the tuple, it is empty when all the Slots are.
+  struct Slot : std::tuple<typename P::Slot...> {};
+
+  template <typename Protocol, typename MakeNew>
+  static typename Protocol::Wrapped make_wrapped(MakeNew&& make_new) {
+    return make_wrapped_from<0, Protocol>(make_new);
+  }
+
+  template <typename Protocol, auto State>
+  static void on_construct(Slot& slot) {
+    construct<Protocol, State>(slot, std::index_sequence_for<P...>());
+  }
+
+  template <typename Protocol, auto From, auto To, auto FunctionPointer,
+            typename Call>
+  static void on_transition(Slot& slot, Call&& call) {
+    transition_from<0, Protocol, From, To, FunctionPointer>(slot, call);
+  }
+
+  template <typename Protocol, auto From, auto FunctionPointer, typename Call>
+  static decltype(auto) on_final_transition(
+      Slot& slot, typename Protocol::Wrapped& wrapped, Call&& call) {
+    return final_transition_from<0, Protocol, From, FunctionPointer>(
+        slot, wrapped, call);
+  }
+
+  template <typename Protocol, auto State>
+  static void on_destroy(Slot& slot) {
+    destroy<Protocol, State>(slot, std::index_sequence_for<P...>());
+  }
+
+ private:
+  template <std::size_t I>
+  using Policy = std::tuple_element_t<I, std::tuple<P...>>;
+
+  template <std::size_t I, typename Protocol, typename MakeNew>
+  static typename Protocol::Wrapped make_wrapped_from(MakeNew& make_new) {
+    if constexpr (I == sizeof...(P)) {
+      return make_new();
+    } else {
+      return Policy<I>::template make_wrapped<Protocol>(
+          [&] { return make_wrapped_from<I + 1, Protocol>(make_new); });
+    }
+  }
+
+  template <typename Protocol, auto State, std::size_t... I>
+  static void construct(Slot& slot, std::index_sequence<I...>) {
+    (Policy<I>::template on_construct<Protocol, State>(
+         std::get<I>(slot)),
+     ...);
+  }
+
+  template <std::size_t I, typename Protocol, auto From, auto To,
+            auto FunctionPointer, typename Call>
+  static void transition_from(Slot& slot, Call& call) {
+    if constexpr (I == sizeof...(P)) {
+      call();
+    } else {
+      Policy<I>::template on_transition<Protocol, From, To, FunctionPointer>(
+          std::get<I>(slot), [&] {
+            transition_from<I + 1, Protocol, From, To, FunctionPointer>(slot,
+                                                                        call);
+          });
+    }
+  }
+
+  template <std::size_t I, typename Protocol, auto From, auto FunctionPointer,
+            typename Call>
+  static decltype(auto) final_transition_from(
+      Slot& slot, typename Protocol::Wrapped& wrapped, Call& call) {
+    if constexpr (I == sizeof...(P)) {
+      return call();
+    } else {
+      return Policy<I>::template on_final_transition<Protocol, From,
+                                                     FunctionPointer>(
+          std::get<I>(slot), wrapped, [&]() -> decltype(auto) {
+            return final_transition_from<I + 1, Protocol, From,
+                                         FunctionPointer>(slot, wrapped,
+                                                          call);
+          });
+    }
+  }
+
+  template <typename Protocol, auto State, std::size_t... I>
+  static void destroy(Slot& slot, std::index_sequence<I...>) {
+    constexpr std::size_t last = sizeof...(P) - 1;
+    (Policy<last - I>::template on_destroy<Protocol, State>(
+         std::get<last - I>(slot)),
+     ...);
+  }
+};
+
 // These macros are just here so that we can end any macro with a semicolon.
 #define PROTENC_MACRO_END_2(LINE) struct some_improbable_long_function_name ## LINE {}
 #define PROTENC_MACRO_END_1(LINE) PROTENC_MACRO_END_2(LINE)
@@ -74,12 +273,14 @@ struct ValidQueries;
 //                   &WRAPPED_TYPE::my_function>,
 //        ...
 //      >"
+//     Each transition can be annotated with Hot<...> or Cold<...>.
 //   - FINAL_TRANSITIONS: The type containing the valid end states. It should
 //     be of the form:
 //     "FinalTransitions<
 //          FinalTransition<start_state, &WRAPPED_TYPE::function_name>,
 //          ...
 //      >"
+//     Each final transition can be annotated with Hot<...> or Cold<...>.
 //   - VALID_QUERIES: The type containing the valid query functions. It should
 //     be of the form:
 //     "ValidQueries<
@@ -87,33 +288,59 @@ struct ValidQueries;
 //          ...
 //      >"
 
+//
+// PROTENC_START_WRAPPER_WITH_POLICY takes one more argument:
+//   - POLICY: The policy of the wrapper (see DefaultPolicy), e.g.
+//     RecyclingPolicy<> (see protenc_recycling.h).
+
 #define PROTENC_START_WRAPPER(WRAPPER_TYPE, WRAPPED_TYPE, STATE_TYPE,          \
                               INITIAL_STATES, TRANSITIONS, FINAL_TRANSITIONS,  \
                               VALID_QUERIES)                                   \
+  PROTENC_START_WRAPPER_WITH_POLICY(WRAPPER_TYPE, WRAPPED_TYPE, STATE_TYPE,    \
+                                    INITIAL_STATES, TRANSITIONS,               \
+                                    FINAL_TRANSITIONS, VALID_QUERIES,          \
+                                    ::prot_enc::DefaultPolicy)
+
+#define PROTENC_START_WRAPPER_WITH_POLICY(WRAPPER_TYPE, WRAPPED_TYPE,          \
+                                          STATE_TYPE, INITIAL_STATES,          \
+                                          TRANSITIONS, FINAL_TRANSITIONS,      \
+                                          VALID_QUERIES, POLICY)               \
   template<STATE_TYPE CurrentState>                                            \
   class WRAPPER_TYPE                                                           \
     : public ::prot_enc::internal::GenericWrapper<                             \
           CurrentState, WRAPPER_TYPE, WRAPPED_TYPE, INITIAL_STATES,            \
-          TRANSITIONS, FINAL_TRANSITIONS, VALID_QUERIES>                       \
+          TRANSITIONS, FINAL_TRANSITIONS, VALID_QUERIES, POLICY>               \
   {                                                                            \
    public:                                                                     \
     using Base =                                                               \
         ::prot_enc::internal::GenericWrapper<                                  \
             CurrentState, WRAPPER_TYPE,  WRAPPED_TYPE, INITIAL_STATES,         \
-            TRANSITIONS, FINAL_TRANSITIONS, VALID_QUERIES>;                    \
+            TRANSITIONS, FINAL_TRANSITIONS, VALID_QUERIES, POLICY>;            \
     using Wrapped = WRAPPED_TYPE;                                              \
    private:                                                                    \
     /* Allow the GenericWrapper to construct an instance of this with a */     \
     /* different state. */                                                     \
     template<auto, template <auto> typename, typename, typename, typename,     \
-             typename, typename>                                               \
+             typename, typename, typename>                                     \
     friend class ::prot_enc::internal::GenericWrapper;                         \
-    WRAPPER_TYPE(Base&& other) : Base(other) {}                                \
+    WRAPPER_TYPE(Base&& other) : Base(std::move(other)) {}                     \
+    /* Build the wrapper in one move of the object. */                         \
+    template <typename... Args>                                                \
+    WRAPPER_TYPE(::prot_enc::internal::RebuildTag tag, Args&&... args)         \
+        : Base(tag, std::forward<Args>(args)...) {}                            \
    public:                                                                     \
-    WRAPPER_TYPE() : Base(Wrapped{}) {}                                        \
+    /* The class of the functions: Wrapped, or T for Borrowed<T>. */           \
+    using Object = typename Base::Object;                                      \
+    /* The lambda has access to the constructor of Wrapped. */                 \
+    WRAPPER_TYPE()                                                             \
+        : Base(::prot_enc::internal::MakeWrappedTag{},                         \
+               [] { return Wrapped{}; }) {}                                    \
     /* Disallow copy constructor. */                                           \
     WRAPPER_TYPE(const WRAPPER_TYPE&) = delete;                                \
     WRAPPER_TYPE& operator=(const WRAPPER_TYPE&) = delete;                     \
+    /* Moving is allowed, to store the wrappers in containers. */              \
+    WRAPPER_TYPE(WRAPPER_TYPE&&) = default;                                    \
+    WRAPPER_TYPE& operator=(WRAPPER_TYPE&&) = default;                         \
     PROTENC_MACRO_END
 
 
@@ -121,7 +348,7 @@ struct ValidQueries;
     template <typename... Args>                               \
     auto name(Args&&... args) && {                            \
       return std::move(*this)                                 \
-          .template call_transition<&Wrapped::name, Args...>( \
+          .template call_transition<&Object::name, Args...>( \
               std::forward<Args>(args)...);                   \
     } PROTENC_MACRO_END
 
@@ -130,14 +357,14 @@ struct ValidQueries;
     template <typename... Args>                                     \
     auto name(Args&&... args) && {                                  \
       return std::move(*this)                                       \
-          .template call_final_transition<&Wrapped::name, Args...>( \
+          .template call_final_transition<&Object::name, Args...>( \
               std::forward<Args>(args)...);                         \
     } PROTENC_MACRO_END
 
 #define PROTENC_DECLARE_QUERY_METHOD(name)                             \
     template <typename... Args>                                        \
     auto name(Args&&... args) const {                                  \
-      return this->template call_valid_query<&Wrapped::name, Args...>( \
+      return this->template call_valid_query<&Object::name, Args...>( \
           std::forward<Args>(args)...);                                \
     } PROTENC_MACRO_END
 
@@ -153,6 +380,41 @@ namespace internal {
 
 struct NotFound{};
 
+// The object whose functions a wrapper calls: the wrapped object itself, or
+// the object it points to for Borrowed.
+template <typename Wrapped>
+struct object_type_t {
+  using type = Wrapped;
+};
+
+template <typename T>
+struct object_type_t<Borrowed<T>> {
+  using type = T;
+};
+
+template <typename Wrapped>
+using object_type = typename object_type_t<Wrapped>::type;
+
+template <typename Wrapped>
+Wrapped& object_of(Wrapped& wrapped) {
+  return wrapped;
+}
+
+template <typename Wrapped>
+const Wrapped& object_of(const Wrapped& wrapped) {
+  return wrapped;
+}
+
+template <typename T>
+T& object_of(Borrowed<T>& wrapped) {
+  return wrapped.get();
+}
+
+template <typename T>
+const T& object_of(const Borrowed<T>& wrapped) {
+  return wrapped.get();
+}
+
 // Get the target state of a transition, if it exists (for this starting state
 // and function pointer).
 template <auto CurrentState, auto FunctionPointer, typename... Transitions>
@@ -186,6 +448,21 @@ struct find_transition_t<CurrentState, FunctionPointer,
   using type = ValidQuery<CurrentState, FunctionPointer>;
 };
 
+// Unwrap the Hot/Cold annotations.
+template <auto CurrentState, auto FunctionPointer, typename Transition,
+          typename... Transitions>
+struct find_transition_t<CurrentState, FunctionPointer, Hot<Transition>,
+                         Transitions...>
+  : find_transition_t<CurrentState, FunctionPointer, Transition,
+                      Transitions...> {};
+
+template <auto CurrentState, auto FunctionPointer, typename Transition,
+          typename... Transitions>
+struct find_transition_t<CurrentState, FunctionPointer, Cold<Transition>,
+                         Transitions...>
+  : find_transition_t<CurrentState, FunctionPointer, Transition,
+                      Transitions...> {};
+
 // Recurse.
 template <auto CurrentState, auto FunctionPointer, typename Transition,
           typename... Transitions>
@@ -228,6 +505,102 @@ using find_transition =
     typename find_transition_t<CurrentState, FunctionPointer, Transitions...>
         ::type;
 
+// How often a transition is taken, from the Hot/Cold annotations.
+enum class TransitionHint { NONE, HOT, COLD };
+
+template <typename T>
+struct hint_of_t {
+  static constexpr TransitionHint value = TransitionHint::NONE;
+  using element = T;
+};
+
+template <typename T>
+struct hint_of_t<Hot<T>> {
+  static constexpr TransitionHint value = TransitionHint::HOT;
+  using element = T;
+};
+
+template <typename T>
+struct hint_of_t<Cold<T>> {
+  static constexpr TransitionHint value = TransitionHint::COLD;
+  using element = T;
+};
+
+// Get the annotation of the transition (or final transition) starting from
+// CurrentState with label FunctionPointer.
+template <typename List, auto CurrentState, auto FunctionPointer>
+struct transition_hint_t {
+  static constexpr TransitionHint value = TransitionHint::NONE;
+};
+
+template <template <typename...> typename List, typename... Element,
+          auto CurrentState, auto FunctionPointer>
+struct transition_hint_t<List<Element...>, CurrentState, FunctionPointer> {
+  static constexpr TransitionHint value = [] {
+    TransitionHint result = TransitionHint::NONE;
+    ((!std::is_same_v<find_transition<CurrentState, FunctionPointer,
+                                      typename hint_of_t<Element>::element>,
+                      NotFound> &&
+      (result = hint_of_t<Element>::value, true)) ||
+     ...);
+    return result;
+  }();
+};
+
+template <typename List, auto CurrentState, auto FunctionPointer>
+constexpr TransitionHint transition_hint =
+    transition_hint_t<List, CurrentState, FunctionPointer>::value;
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PROTENC_HOT_FUNCTION [[gnu::hot, gnu::always_inline]]
+#define PROTENC_COLD_FUNCTION [[gnu::cold, gnu::noinline]]
+#else
+#define PROTENC_HOT_FUNCTION
+#define PROTENC_COLD_FUNCTION
+#endif
+
+// Call the member function on the object, with the code layout given by the
+// hint: hot calls are forced inline, cold calls are kept out of line (and out
+// of the hot text section).
+template <TransitionHint Hint>
+struct call_with_hint {
+  template <auto FunctionPointer, typename Object, typename... Args>
+  static decltype(auto) call(Object&& object, Args&&... args) {
+    return (std::forward<Object>(object).*FunctionPointer)(
+        std::forward<Args>(args)...);
+  }
+};
+
+template <>
+struct call_with_hint<TransitionHint::HOT> {
+  template <auto FunctionPointer, typename Object, typename... Args>
+  PROTENC_HOT_FUNCTION static decltype(auto) call(Object&& object,
+                                                  Args&&... args) {
+    return (std::forward<Object>(object).*FunctionPointer)(
+        std::forward<Args>(args)...);
+  }
+};
+
+template <>
+struct call_with_hint<TransitionHint::COLD> {
+  template <auto FunctionPointer, typename Object, typename... Args>
+  PROTENC_COLD_FUNCTION static decltype(auto) call(Object&& object,
+                                                   Args&&... args) {
+    return (std::forward<Object>(object).*FunctionPointer)(
+        std::forward<Args>(args)...);
+  }
+};
+
+// Call the function of the transition (or final transition) of the list,
+// starting from CurrentState with label FunctionPointer.
+template <typename List, auto CurrentState, auto FunctionPointer,
+          typename Object, typename... Args>
+decltype(auto) call_transition_function(Object&& object, Args&&... args) {
+  return call_with_hint<transition_hint<List, CurrentState, FunctionPointer>>::
+      template call<FunctionPointer>(std::forward<Object>(object),
+                                     std::forward<Args>(args)...);
+}
+
 
 // Get the target state of a transition, if it exists (for this starting state
 // and function pointer).
@@ -322,6 +695,33 @@ template<class R, class T, class... Args>
 struct is_pointer_to_r_value_member_function<R (T::*)(Args...) &&>
   : std::true_type {};
 
+// Decayed argument types of a pointer to member function, as a tuple. It is
+// the type used to store the arguments of a call for later.
+// function_arguments<decltype(&MyClass::f)> -> std::tuple<Args...>
+template <class T>
+struct function_arguments_t;
+
+#define PROTENC_FUNCTION_ARGUMENTS(QUALIFIERS)                     \
+  template <class R, class T, class... Args>                       \
+  struct function_arguments_t<R (T::*)(Args...) QUALIFIERS> {      \
+    using type = std::tuple<std::decay_t<Args>...>;                \
+  }
+PROTENC_FUNCTION_ARGUMENTS();
+PROTENC_FUNCTION_ARGUMENTS(const);
+PROTENC_FUNCTION_ARGUMENTS(&);
+PROTENC_FUNCTION_ARGUMENTS(&&);
+PROTENC_FUNCTION_ARGUMENTS(const&);
+PROTENC_FUNCTION_ARGUMENTS(noexcept);
+PROTENC_FUNCTION_ARGUMENTS(const noexcept);
+PROTENC_FUNCTION_ARGUMENTS(& noexcept);
+PROTENC_FUNCTION_ARGUMENTS(&& noexcept);
+PROTENC_FUNCTION_ARGUMENTS(const& noexcept);
+#undef PROTENC_FUNCTION_ARGUMENTS
+
+template <class T>
+using function_arguments =
+    typename function_arguments_t<std::remove_cv_t<T>>::type;
+
 // Check that the types used to define the initial states, transitions and so
 // on are correct.
 template <template <typename...> typename ListType, typename Value>
@@ -339,6 +739,422 @@ template <template <auto...> typename ListType,  typename ValueType,
 struct is_correct_value_list_type<ListType, ValueType, ListType<Elements...>>
   : std::true_type {};
 
+// Concatenate several arrays of states into one.
+template <typename StateType, std::size_t... N>
+constexpr auto concat_states(const std::array<StateType, N>&... arrays) {
+  std::array<StateType, (N + ... + 0)> result{};
+  [[maybe_unused]] auto position = result.begin();
+  ((position = std::copy(arrays.begin(), arrays.end(), position)), ...);
+  return result;
+}
+
+// List the states mentioned in an element of the FSM description (with
+// duplicates).
+template <typename StateType, typename T>
+struct mentioned_states_t {
+  static constexpr std::array<StateType, 0> value{};
+};
+
+template <typename StateType, auto... State>
+struct mentioned_states_t<StateType, InitialStates<State...>> {
+  static constexpr std::array<StateType, sizeof...(State)> value{State...};
+};
+
+template <typename StateType, auto StartState, auto EndState,
+          auto FunctionPointer>
+struct mentioned_states_t<StateType,
+                          Transition<StartState, EndState, FunctionPointer>> {
+  static constexpr std::array<StateType, 2> value{StartState, EndState};
+};
+
+template <typename StateType, auto StartState, auto FunctionPointer>
+struct mentioned_states_t<StateType,
+                          FinalTransition<StartState, FunctionPointer>> {
+  static constexpr std::array<StateType, 1> value{StartState};
+};
+
+template <typename StateType, auto StartState, auto FunctionPointer>
+struct mentioned_states_t<StateType, ValidQuery<StartState, FunctionPointer>> {
+  static constexpr std::array<StateType, 1> value{StartState};
+};
+
+template <typename StateType, template <typename...> typename List,
+          typename... Element>
+struct mentioned_states_t<StateType, List<Element...>> {
+  static constexpr auto value = concat_states<StateType>(
+      mentioned_states_t<StateType, Element>::value...);
+};
+
+// Number of distinct values in the array.
+template <typename StateType, std::size_t N>
+constexpr std::size_t count_unique_states(
+    const std::array<StateType, N>& states) {
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < N; ++i) {
+    bool seen = false;
+    for (std::size_t j = 0; j < i; ++j) {
+      seen = seen || states[j] == states[i];
+    }
+    count += !seen;
+  }
+  return count;
+}
+
+// Distinct values of the array, in order of first appearance.
+template <std::size_t M, typename StateType, std::size_t N>
+constexpr std::array<StateType, M> unique_states(
+    const std::array<StateType, N>& states) {
+  std::array<StateType, M> result{};
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < N; ++i) {
+    bool seen = false;
+    for (std::size_t j = 0; j < count; ++j) {
+      seen = seen || result[j] == states[i];
+    }
+    if (!seen) {
+      result[count++] = states[i];
+    }
+  }
+  return result;
+}
+
+template <auto FunctionPointer>
+struct function_constant {};
+
+// Check whether two function pointers (of possibly different types) are the
+// same. They are compared as template arguments: comparing member function
+// pointers with == is not always a constant expression (e.g. with GCC and
+// -fsanitize=undefined).
+template <auto FunctionPointer, auto OtherFunctionPointer>
+constexpr bool same_function() {
+  return std::is_same_v<function_constant<FunctionPointer>,
+                        function_constant<OtherFunctionPointer>>;
+}
+
+// Start state, end state and function of an element of the FSM description.
+// Final transitions and queries end where they start.
+template <typename T>
+struct edge_traits;
+
+template <auto StartState, auto EndState, auto FunctionPointer>
+struct edge_traits<Transition<StartState, EndState, FunctionPointer>> {
+  static constexpr auto start = StartState;
+  static constexpr auto end = EndState;
+  static constexpr auto function = FunctionPointer;
+};
+
+template <auto StartState, auto FunctionPointer>
+struct edge_traits<FinalTransition<StartState, FunctionPointer>> {
+  static constexpr auto start = StartState;
+  static constexpr auto end = StartState;
+  static constexpr auto function = FunctionPointer;
+};
+
+template <auto StartState, auto FunctionPointer>
+struct edge_traits<ValidQuery<StartState, FunctionPointer>> {
+  static constexpr auto start = StartState;
+  static constexpr auto end = StartState;
+  static constexpr auto function = FunctionPointer;
+};
+
+template <typename T>
+struct edge_traits<Hot<T>> : edge_traits<T> {};
+
+template <typename T>
+struct edge_traits<Cold<T>> : edge_traits<T> {};
+
+// Number the functions of a list of edges, in order of first appearance:
+// `same[i][j]` tells whether the edges i and j have the same function, and the
+// result is the function number of each edge.
+template <std::size_t N>
+constexpr std::array<std::size_t, N> number_functions(
+    const std::array<std::array<bool, N>, N>& same) {
+  std::array<std::size_t, N> result{};
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < N; ++i) {
+    std::size_t j = 0;
+    while (!same[i][j]) ++j;
+    result[i] = j == i ? count++ : result[j];
+  }
+  return result;
+}
+
+// Tables describing a list of edges (e.g. Transitions<...>). The distinct
+// functions of the list are the "methods", numbered in order of first
+// appearance.
+template <typename State, typename List>
+struct edge_table_t;
+
+template <typename State, template <typename...> typename List,
+          typename... Edge>
+struct edge_table_t<State, List<Edge...>> {
+  static constexpr std::size_t num_edges = sizeof...(Edge);
+
+  static constexpr std::array<State, num_edges> starts{
+      edge_traits<Edge>::start...};
+  static constexpr std::array<State, num_edges> ends{edge_traits<Edge>::end...};
+
+  // Function of the edge I.
+  template <std::size_t I>
+  static constexpr auto function =
+      std::get<I>(std::tuple{edge_traits<Edge>::function...});
+
+  // For each edge, whether it has the function FunctionPointer.
+  template <auto FunctionPointer>
+  static constexpr std::array<bool, num_edges> has_function{
+      same_function<FunctionPointer, edge_traits<Edge>::function>()...};
+
+  // Method number of each edge.
+  static constexpr std::array<std::size_t, num_edges> method_of_edge =
+      number_functions<num_edges>(
+          {has_function<edge_traits<Edge>::function>...});
+
+  static constexpr std::size_t num_methods =
+      num_edges == 0 ? 0
+                     : *std::max_element(method_of_edge.begin(),
+                                         method_of_edge.end()) + 1;
+
+  // First edge of each method.
+  static constexpr std::array<std::size_t, num_methods> first_edge_of_method =
+      [] {
+        std::array<std::size_t, num_methods> result{};
+        for (std::size_t i = num_edges; i > 0; --i) {
+          result[method_of_edge[i - 1]] = i - 1;
+        }
+        return result;
+      }();
+
+  // Method number of the function, or num_methods if it is not in the list.
+  template <auto FunctionPointer>
+  static constexpr std::size_t method_index = [] {
+    for (std::size_t i = 0; i < num_edges; ++i) {
+      if (has_function<FunctionPointer>[i]) return method_of_edge[i];
+    }
+    return num_methods;
+  }();
+
+  // Function of the method M.
+  template <std::size_t M>
+  static constexpr auto method = function<first_edge_of_method[M]>;
+};
+
+// Compile-time description of a protocol, shared by the wrappers in all the
+// states. It is what the containers and tools built on top of the wrappers
+// (e.g. StatePool) use to enumerate the states and reach the other wrappers.
+template <typename StateType,
+          template <auto State> typename WrapperTemplate,
+          typename WrappedType, typename InitialStatesType,
+          typename TransitionsType, typename FinalTransitionsType,
+          typename ValidQueriesType, typename PolicyType>
+struct Protocol {
+  using State = StateType;
+  using Wrapped = WrappedType;
+  // The class of the functions (see Borrowed).
+  using Object = object_type<Wrapped>;
+  using Policy = PolicyType;
+  using InitialStates = InitialStatesType;
+  using Transitions = TransitionsType;
+  using FinalTransitions = FinalTransitionsType;
+  using ValidQueries = ValidQueriesType;
+
+  template <State S>
+  using Wrapper = WrapperTemplate<S>;
+
+ private:
+  static constexpr auto all_mentioned_states = concat_states<State>(
+      mentioned_states_t<State, InitialStates>::value,
+      mentioned_states_t<State, Transitions>::value,
+      mentioned_states_t<State, FinalTransitions>::value,
+      mentioned_states_t<State, ValidQueries>::value);
+
+ public:
+  // Every state mentioned in the protocol, in order of first appearance
+  // (initial states first). The position of a state in this list is its
+  // index, used by the containers to lay out their per-state storage.
+  static constexpr std::size_t num_states =
+      count_unique_states(all_mentioned_states);
+  static constexpr std::array<State, num_states> states =
+      unique_states<num_states>(all_mentioned_states);
+
+  // Index of the state in `states`, or num_states if it is not part of the
+  // protocol.
+  static constexpr std::size_t index_of(State state) {
+    for (std::size_t i = 0; i < num_states; ++i) {
+      if (states[i] == state) return i;
+    }
+    return num_states;
+  }
+
+  template <State S>
+  static constexpr std::size_t index_of_v = index_of(S);
+
+ private:
+  using TransitionTable = edge_table_t<State, Transitions>;
+
+ public:
+  // The methods are the distinct functions of the transitions, numbered in
+  // order of first appearance.
+  static constexpr std::size_t num_methods = TransitionTable::num_methods;
+
+  // Index of the method, or num_methods if it is not a transition function.
+  template <auto FunctionPointer>
+  static constexpr std::size_t method_index =
+      TransitionTable::template method_index<FunctionPointer>;
+
+  // Function pointer of the method M.
+  template <std::size_t M>
+  static constexpr auto method = TransitionTable::template method<M>;
+
+  // Index of the state reached by taking the method from the state, both given
+  // by index. Invalid transitions lead to num_states.
+  static constexpr std::array<std::size_t, num_states * num_methods>
+      transition_table = [] {
+        std::array<std::size_t, num_states * num_methods> result{};
+        for (std::size_t& next : result) next = num_states;
+        for (std::size_t i = 0; i < TransitionTable::num_edges; ++i) {
+          result[index_of(TransitionTable::starts[i]) * num_methods +
+                 TransitionTable::method_of_edge[i]] =
+              index_of(TransitionTable::ends[i]);
+        }
+        return result;
+      }();
+
+  static constexpr std::size_t next_state_index(std::size_t state_index,
+                                                std::size_t method_index) {
+    return transition_table[state_index * num_methods + method_index];
+  }
+
+ private:
+  using FinalTransitionTable = edge_table_t<State, FinalTransitions>;
+
+ public:
+  // The final methods are the distinct functions of the final transitions,
+  // numbered separately from the methods.
+  static constexpr std::size_t num_final_methods =
+      FinalTransitionTable::num_methods;
+
+  // Index of the final method, or num_final_methods if it is not a final
+  // transition function.
+  template <auto FunctionPointer>
+  static constexpr std::size_t final_method_index =
+      FinalTransitionTable::template method_index<FunctionPointer>;
+
+  // Function pointer of the final method M.
+  template <std::size_t M>
+  static constexpr auto final_method = FinalTransitionTable::template method<M>;
+
+  // Whether the final method can be called from the state, both given by
+  // index.
+  static constexpr std::array<bool, num_states * num_final_methods>
+      final_transition_table = [] {
+        std::array<bool, num_states * num_final_methods> result{};
+        for (std::size_t i = 0; i < FinalTransitionTable::num_edges; ++i) {
+          result[index_of(FinalTransitionTable::starts[i]) *
+                     num_final_methods +
+                 FinalTransitionTable::method_of_edge[i]] = true;
+        }
+        return result;
+      }();
+
+  static constexpr bool is_final_transition(std::size_t state_index,
+                                            std::size_t final_method_index) {
+    return final_transition_table[state_index * num_final_methods +
+                                  final_method_index];
+  }
+};
+
+// Variant of the argument tuples of every method of the protocol: the
+// alternative M holds the arguments of the method M. It stores a call to a
+// method only chosen at runtime.
+template <typename Protocol, typename Indices>
+struct method_arguments_variant_t;
+
+template <typename Protocol, std::size_t... M>
+struct method_arguments_variant_t<Protocol, std::index_sequence<M...>> {
+  using type = std::variant<
+      function_arguments<decltype(Protocol::template method<M>)>...>;
+};
+
+template <typename Protocol>
+using method_arguments_variant = typename method_arguments_variant_t<
+    Protocol, std::make_index_sequence<Protocol::num_methods>>::type;
+
+// Whether T is a wrapper (in any state) of the protocol.
+template <typename T, typename Protocol>
+constexpr bool is_wrapper_of() {
+  if constexpr (requires { typename T::Protocol; }) {
+    return std::is_same_v<typename T::Protocol, Protocol>;
+  } else {
+    return false;
+  }
+}
+
+// Tag of the constructor of GenericWrapper taking the object from the policy.
+struct MakeWrappedTag {};
+
+// Tag of the constructor of the wrappers rebuilding a wrapper in a new state,
+// without the checks and hooks of the public constructors.
+struct RebuildTag {};
+
+// An object taken out of its wrapper along with the Slot of the policy, so that
+// a container can store it (e.g. StatePool, AnyState) while the policy still
+// sees the same object when the wrapper is rebuilt.
+template <typename Protocol>
+struct StoredObject {
+  typename Protocol::Wrapped wrapped;
+  [[no_unique_address]] typename Protocol::Policy::Slot slot;
+};
+
+// Gives the tools of this library access to the wrapped object of a wrapper,
+// and lets them rebuild a wrapper in any state of the protocol (not only the
+// initial ones) around an object they took from another wrapper.
+struct WrapperAccess {
+  template <typename Wrapper>
+  static typename Wrapper::Wrapped& wrapped(Wrapper& wrapper) {
+    return wrapper.wrapped_;
+  }
+
+  template <typename Wrapper>
+  static const typename Wrapper::Wrapped& wrapped(const Wrapper& wrapper) {
+    return wrapper.wrapped_;
+  }
+
+  // Move the object and the Slot out of the wrapper, which is left moved-from
+  // (its policy then ignores its destruction).
+  template <typename Wrapper>
+  static StoredObject<typename Wrapper::Protocol> take(Wrapper& wrapper) {
+    return {std::move(wrapper.wrapped_), std::move(wrapper.slot_)};
+  }
+
+  // Rebuild the wrapper around an object taken with take().
+  template <typename Wrapper>
+  static Wrapper make(StoredObject<typename Wrapper::Protocol>&& object) {
+    return Wrapper::Base::template make_wrapper<Wrapper::state>(
+        std::move(object.wrapped), std::move(object.slot));
+  }
+
+  // Call the on_destroy() hook of the policy for an object taken with take(),
+  // destroyed without being put back in a wrapper. The state is given by its
+  // index in Protocol::states.
+  template <typename Protocol>
+  static void destroy(std::size_t state_index,
+                      StoredObject<Protocol>& object) {
+    static constexpr auto hooks = destroy_hooks<Protocol>(
+        std::make_index_sequence<Protocol::num_states>());
+    hooks[state_index](object.slot);
+  }
+
+ private:
+  template <typename Protocol, std::size_t... I>
+  static constexpr auto destroy_hooks(std::index_sequence<I...>) {
+    using Slot = typename Protocol::Policy::Slot;
+    return std::array<void (*)(Slot&), sizeof...(I)>{[](Slot& slot) {
+      Protocol::Policy::template on_destroy<Protocol, Protocol::states[I]>(
+          slot);
+    }...};
+  }
+};
+
 // Generic wrapper: it's the class that checks the validity of the transitions,
 // and calls the functions.
 template<
@@ -357,7 +1173,9 @@ template<
          // The list of valid end states. See PROTENC_START_WRAPPER.
          typename FinalTransitions,
          // The list of valid query function. See PROTENC_START_WRAPPER.
-         typename ValidQueries
+         typename ValidQueries,
+         // The policy of the wrapper. See DefaultPolicy.
+         typename Policy
         >
 class GenericWrapper {
   static_assert(is_correct_value_list_type<::prot_enc::InitialStates,
@@ -384,17 +1202,58 @@ class GenericWrapper {
   template <auto NewState>
   using ThisWrapper = GenericWrapper<NewState, Wrapper, Wrapped, InitialStates,
                                      Transitions, FinalTransitions,
-                                     ValidQueries>;
+                                     ValidQueries, Policy>;
+
+  // Description of the whole protocol, common to all the states.
+  using Protocol =
+      ::prot_enc::internal::Protocol<decltype(CurrentState), Wrapper, Wrapped,
+                                     InitialStates, Transitions,
+                                     FinalTransitions, ValidQueries, Policy>;
+
+  // The class of the functions of the protocol: Wrapped, or T when the
+  // wrapper borrows its object as a Borrowed<T>.
+  using Object = object_type<Wrapped>;
+
+  // The state of this wrapper.
+  static constexpr auto state = CurrentState;
+
+  // Wrapper around an object it doesn't own, when Wrapped is a Borrowed<T>.
+  // The wrapper must be in an initial state.
+  static Wrapper<CurrentState> borrow(Object& object)
+    requires(!std::is_same_v<Object, Wrapped>)
+  {
+    return Wrapper<CurrentState>(ThisWrapper<CurrentState>{Wrapped(object)});
+  }
+
+  GenericWrapper(GenericWrapper&&) = default;
+
+  // Replace the object by the one of another wrapper in the same state, e.g.
+  // in a loop on a transition to the same state:
+  //   builder = std::move(builder).add_header(header);
+  GenericWrapper& operator=(GenericWrapper&& other) {
+    Policy::template on_destroy<Protocol, CurrentState>(slot_);
+    wrapped_ = std::move(other.wrapped_);
+    slot_ = std::move(other.slot_);
+    return *this;
+  }
+
+  ~GenericWrapper() {
+    Policy::template on_destroy<Protocol, CurrentState>(slot_);
+  }
 
   // Check that the transition is valid, then call the function, and return the
   // wrapper with the updated state.
   template <auto FunctionPointer, typename... Args>
     auto call_transition(Args&&... args) && {
-      (wrapped_.*FunctionPointer)(std::forward<Args>(args)...);
       constexpr auto target_state =
           return_of_transition<Transitions, CurrentState, FunctionPointer>;
-      return Wrapper<target_state>(
-                ThisWrapper<target_state>{std::move(wrapped_), true});
+      Policy::template on_transition<Protocol, CurrentState, target_state,
+                                     FunctionPointer>(slot_, [&] {
+        call_transition_function<Transitions, CurrentState, FunctionPointer>(
+            object_of(wrapped_), std::forward<Args>(args)...);
+      });
+      return make_wrapper<target_state>(std::move(wrapped_),
+                                        std::move(slot_));
     }
 
   // Check that the final transiton is valid, then call the function and return
@@ -402,12 +1261,18 @@ class GenericWrapper {
   template <auto FunctionPointer, typename... Args>
   auto call_final_transition(Args&&... args) &&
     -> return_of_final_transition<FinalTransitions, CurrentState,
-                                  FunctionPointer, Wrapped, Args...> {
+                                  FunctionPointer, Object, Args...> {
     static_assert(is_pointer_to_r_value_member_function<
                       decltype(FunctionPointer)>::value,
                   "Final transition functions should consume the object: "
                   "add && after the argument list.");
-    return (std::move(wrapped_).*FunctionPointer)(std::forward<Args>(args)...);
+    return Policy::template on_final_transition<Protocol, CurrentState,
+                                                FunctionPointer>(
+        slot_, wrapped_, [&]() -> decltype(auto) {
+          return call_transition_function<FinalTransitions, CurrentState,
+                                          FunctionPointer>(
+              std::move(object_of(wrapped_)), std::forward<Args>(args)...);
+        });
   }
 
   // Check that the query is valid, then call the function and return the
@@ -415,28 +1280,52 @@ class GenericWrapper {
   template <auto FunctionPointer, typename... Args>
   auto call_valid_query(Args&&... args) const
     -> return_of_valid_query<ValidQueries, CurrentState, FunctionPointer,
-                             Wrapped, Args...> {
-    return (wrapped_.*FunctionPointer)(std::forward<Args>(args)...);
+                             Object, Args...> {
+    return (object_of(wrapped_).*FunctionPointer)(std::forward<Args>(args)...);
   }
 
  protected:
   // Needed to build the wrapper with a different state.
   template<auto, template <auto> typename, typename, typename, typename,
-           typename, typename>
+           typename, typename, typename>
   friend class GenericWrapper;
+  friend struct WrapperAccess;
   // Constructor. Only take by move to prevent accidental copy.
   GenericWrapper(Wrapped&& wrapped) : wrapped_(std::move(wrapped)) {
     this->template check_initial_state<CurrentState>();
+    Policy::template on_construct<Protocol, CurrentState>(slot_);
   }
+  // Constructor with the object given by the policy, where make_new() creates
+  // a new one.
+  template <typename MakeNew>
+  GenericWrapper(MakeWrappedTag, MakeNew&& make_new)
+      : wrapped_(Policy::template make_wrapped<Protocol>(
+            std::forward<MakeNew>(make_new))) {
+    this->template check_initial_state<CurrentState>();
+    Policy::template on_construct<Protocol, CurrentState>(slot_);
+  }
+  using Slot = typename Policy::Slot;
+
+  GenericWrapper(RebuildTag, Wrapped&& wrapped, Slot&& slot)
+      : wrapped_(std::move(wrapped)), slot_(std::move(slot)) {}
  private:
-  GenericWrapper(Wrapped&& wrapped, bool ignore_check) : wrapped_(std::move(wrapped)) {}
+  // Build the wrapper in the given state, without checking that it is an
+  // initial state.
+  template <auto NewState>
+  static Wrapper<NewState> make_wrapper(Wrapped&& wrapped, Slot&& slot = {}) {
+    return Wrapper<NewState>(RebuildTag{}, std::move(wrapped),
+                             std::move(slot));
+  }
   template <auto State>
   void check_initial_state() const {
     static_assert(check_initial_state_v<State, InitialStates>::value,
                   "State is not an initial state");
   }
   Wrapped wrapped_;
+  [[no_unique_address]] Slot slot_;
 };
 
 } // namespace internal
 } // namespace prot_enc
+
+#endif // PROTENC_H_
@@ -0,0 +1,279 @@
+/**********************************
+ * MIT License (see LICENSE).     *
+ *                                *
+ * Copyright (c) 2019 nitnelave   *
+ *                                *
+ **********************************
+ *
+ *
+ * ProtEnc -- Object in a state only known at runtime
+ *
+ * AnyState holds an object of a protocol in any of its states, as the wrapped
+ * object and a one-byte state index, instead of a std::variant of all the
+ * wrappers. Getting the wrapper back is a single comparison of the index, and
+ * visiting it goes through a jump table indexed by the state.
+ **/
+
+#ifndef PROTENC_ANY_STATE_H_
+#define PROTENC_ANY_STATE_H_
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "protenc.h"
+
+namespace prot_enc {
+
+namespace internal {
+// Gives the batch transitions (see protenc_batch.h) the transitions of AnyState
+// from a state checked beforehand.
+struct AnyStateAccess;
+} // namespace internal
+
+// Object of the protocol of AnyWrapper (the wrapper in any state of the
+// protocol), in a state only known at runtime, e.g.:
+//   using Builder =
+//       AnyState<HTTPConnectionBuilderWrapper<HTTPBuilderState::START>>;
+//   Builder builder(GetConnectionBuilder().add_header("header"));
+//   auto headers = std::move(builder).try_as<HTTPBuilderState::HEADERS>();
+//   if (headers) { ... }
+// The object keeps the Slot of the policy of its wrapper. If it is destroyed in
+// the AnyState, the policy sees the destruction of a wrapper in its state.
+template <typename AnyWrapper>
+class AnyState {
+ public:
+  using Protocol = typename AnyWrapper::Protocol;
+  using State = typename Protocol::State;
+  using Wrapped = typename Protocol::Wrapped;
+  template <State S>
+  using Wrapper = typename Protocol::template Wrapper<S>;
+
+  static constexpr std::size_t num_states = Protocol::num_states;
+  // State index of an AnyState whose object was moved out.
+  static constexpr std::uint8_t empty_index = 0xff;
+  static_assert(num_states < empty_index,
+                "Too many states to store the state in one byte");
+
+  // Take the object of the wrapper, in any state of the protocol.
+  template <typename W>
+    requires(internal::is_wrapper_of<W, Protocol>())
+  AnyState(W wrapper)
+      : object_(internal::WrapperAccess::take(wrapper)),
+        state_index_(index_of<W>()) {}
+
+  template <typename W>
+    requires(internal::is_wrapper_of<W, Protocol>())
+  AnyState& operator=(W wrapper) {
+    destroy_object();
+    object_ = internal::WrapperAccess::take(wrapper);
+    state_index_ = index_of<W>();
+    return *this;
+  }
+
+  AnyState(AnyState&& other)
+      : object_(std::move(other.object_)), state_index_(other.state_index_) {
+    other.state_index_ = empty_index;
+  }
+
+  AnyState& operator=(AnyState&& other) {
+    if (this == &other) return *this;
+    destroy_object();
+    object_ = std::move(other.object_);
+    state_index_ = other.state_index_;
+    other.state_index_ = empty_index;
+    return *this;
+  }
+
+  ~AnyState() { destroy_object(); }
+
+  // Index of the current state in Protocol::states, or empty_index.
+  std::uint8_t state_index() const { return state_index_; }
+
+  State state() const {
+    assert(!empty() && "The object was moved out");
+    return Protocol::states[state_index_];
+  }
+
+  bool empty() const { return state_index_ == empty_index; }
+
+  // Whether the object is in the state S.
+  template <State S>
+  bool is() const {
+    return state_index_ == Protocol::template index_of_v<S>;
+  }
+
+  // Move the object out as a Wrapper<S>, if it is in the state S.
+  template <State S>
+  std::optional<Wrapper<S>> try_as() && {
+    if (!is<S>()) return std::nullopt;
+    state_index_ = empty_index;
+    return internal::WrapperAccess::make<Wrapper<S>>(std::move(object_));
+  }
+
+  // Move the object out as a wrapper in its current state, and call the
+  // visitor with it. The visitor must return the same type for every state,
+  // or a wrapper of the protocol for every state: the result is then an
+  // AnyState, so that a transition can be written:
+  //   any = std::move(any).visit([](auto wrapper) -> ... { ... });
+  // There is no wrapper to visit in an empty AnyState: it aborts.
+  template <typename Visitor>
+  auto visit(Visitor&& visitor) && {
+    assert(!empty() && "The object was moved out");
+    if (empty()) [[unlikely]] std::abort();
+    using V = std::remove_reference_t<Visitor>;
+    const std::uint8_t state_index = state_index_;
+    state_index_ = empty_index;
+    return visitors<V>[state_index](std::move(object_), visitor);
+  }
+
+  // State index reached by the transition FunctionPointer from each state
+  // index, or empty_index where the transition is not valid.
+  template <auto FunctionPointer>
+  static constexpr std::array<std::uint8_t, 256> next_state_indices = [] {
+    constexpr std::size_t method =
+        Protocol::template method_index<FunctionPointer>;
+    static_assert(method < Protocol::num_methods,
+                  "The function is not a transition of the protocol");
+    std::array<std::uint8_t, 256> result{};
+    for (std::uint8_t& next : result) next = empty_index;
+    for (std::size_t state = 0; state < num_states; ++state) {
+      const std::size_t next = Protocol::next_state_index(state, method);
+      if (next != num_states) result[state] = static_cast<std::uint8_t>(next);
+    }
+    return result;
+  }();
+
+  // Take the transition FunctionPointer from the current state, if it is valid
+  // there. Returns whether the transition was taken.
+  template <auto FunctionPointer, typename... Args>
+  bool transition(Args&&... args) {
+    constexpr std::size_t method =
+        Protocol::template method_index<FunctionPointer>;
+    static_assert(method < Protocol::num_methods,
+                  "The function is not a transition of the protocol");
+    const auto function = transitions<method, Args&&...>[state_index_];
+    if (function == nullptr) [[unlikely]] return false;
+    state_index_ = function(object_, std::forward<Args>(args)...);
+    return true;
+  }
+
+ private:
+  friend struct internal::AnyStateAccess;
+
+  using Stored = internal::StoredObject<Protocol>;
+
+  // Take the transition FunctionPointer from the state S, which the object is
+  // known to be in.
+  template <State S, auto FunctionPointer, typename... Args>
+  void transition_from(Args&&... args) {
+    assert(is<S>() && "The object is not in this state");
+    auto result = internal::WrapperAccess::make<Wrapper<S>>(std::move(object_))
+                      .template call_transition<FunctionPointer>(
+                          std::forward<Args>(args)...);
+    object_ = internal::WrapperAccess::take(result);
+    state_index_ = index_of<decltype(result)>();
+  }
+
+  void destroy_object() {
+    if (!empty()) internal::WrapperAccess::destroy(state_index_, object_);
+    state_index_ = empty_index;
+  }
+
+  template <typename W>
+  static constexpr std::uint8_t index_of() {
+    return static_cast<std::uint8_t>(Protocol::index_of(W::state));
+  }
+
+  // Result of the visitor in the state of index I.
+  template <typename Visitor, std::size_t I>
+  using visitor_result =
+      std::invoke_result_t<Visitor&, Wrapper<Protocol::states[I]>>;
+
+  template <typename Visitor, std::size_t... I>
+  static constexpr auto visit_result(std::index_sequence<I...>) {
+    if constexpr ((internal::is_wrapper_of<visitor_result<Visitor, I>,
+                                           Protocol>() &&
+                   ...)) {
+      return std::type_identity<AnyState>{};
+    } else {
+      static_assert(
+          (std::is_same_v<visitor_result<Visitor, 0>,
+                          visitor_result<Visitor, I>> && ...),
+          "The visitor should return the same type in every state, or a "
+          "wrapper of the protocol");
+      return std::type_identity<visitor_result<Visitor, 0>>{};
+    }
+  }
+
+  template <typename Visitor>
+  using VisitResult = typename decltype(visit_result<Visitor>(
+      std::make_index_sequence<num_states>()))::type;
+
+  template <typename Visitor, std::size_t I>
+  static VisitResult<Visitor> visit_state(Stored&& object, Visitor& visitor) {
+    using W = Wrapper<Protocol::states[I]>;
+    return visitor(internal::WrapperAccess::make<W>(std::move(object)));
+  }
+
+  template <typename Visitor, std::size_t... I>
+  static constexpr auto make_visitors(std::index_sequence<I...>) {
+    return std::array<VisitResult<Visitor> (*)(Stored&&, Visitor&),
+                      num_states>{&visit_state<Visitor, I>...};
+  }
+
+  // Jump table of the visitor, indexed by state.
+  template <typename Visitor>
+  static constexpr auto visitors =
+      make_visitors<Visitor>(std::make_index_sequence<num_states>());
+
+  // Take the transition of the method from the state of index I, and return
+  // the index of the new state.
+  template <std::size_t Method, std::size_t I, typename... Args>
+  static std::uint8_t transition_state(Stored& object, Args... args) {
+    constexpr State state = Protocol::states[I];
+    auto result = internal::WrapperAccess::make<Wrapper<state>>(
+                      std::move(object))
+                      .template call_transition<
+                          Protocol::template method<Method>>(
+                          std::forward<Args>(args)...);
+    object = internal::WrapperAccess::take(result);
+    return index_of<decltype(result)>();
+  }
+
+  template <std::size_t Method, std::size_t I, typename... Args>
+  static constexpr auto transition_function() {
+    using Function = std::uint8_t (*)(Stored&, Args...);
+    if constexpr (Protocol::next_state_index(I, Method) == num_states) {
+      return Function{nullptr};
+    } else {
+      return Function{&transition_state<Method, I, Args...>};
+    }
+  }
+
+  template <std::size_t Method, typename... Args, std::size_t... I>
+  static constexpr auto make_transitions(std::index_sequence<I...>) {
+    // One entry for every possible index: the ones after the last state
+    // (including the empty index) are nullptr.
+    return std::array<std::uint8_t (*)(Stored&, Args...), 256>{
+        transition_function<Method, I, Args...>()...};
+  }
+
+  // Jump table of the transition of the method, indexed by state (nullptr
+  // where it is not valid).
+  template <std::size_t Method, typename... Args>
+  static constexpr auto transitions = make_transitions<Method, Args...>(
+      std::make_index_sequence<num_states>());
+
+  Stored object_;
+  std::uint8_t state_index_;
+};
+
+} // namespace prot_enc
+
+#endif // PROTENC_ANY_STATE_H_
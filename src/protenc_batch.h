@@ -0,0 +1,257 @@
+/**********************************
+ * MIT License (see LICENSE).     *
+ *                                *
+ * Copyright (c) 2019 nitnelave   *
+ *                                *
+ **********************************
+ *
+ *
+ * ProtEnc -- Batch transitions on objects in runtime states
+ *
+ * Take the same transition on a batch of AnyState objects. The states of the
+ * batch are checked 16 at a time: the state indices are gathered in a vector
+ * register and looked up in the table of the valid transitions of the method
+ * with a byte shuffle, which partitions the batch into valid and invalid
+ * positions without a branch per object. The valid positions are then grouped
+ * by state, and each group takes the transition of its state in a loop, with
+ * the next state known at compile time: no lookup nor indirect call per
+ * object.
+ **/
+
+#ifndef PROTENC_BATCH_H_
+#define PROTENC_BATCH_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// The shuffle is SSSE3 on x86: used directly when the compiler targets it, and
+// otherwise selected at runtime if the CPU has it (the default flags of the
+// compilers only target SSE2).
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define PROTENC_BATCH_SSSE3
+#elif (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#include <tmmintrin.h>
+#define PROTENC_BATCH_SSSE3
+#define PROTENC_BATCH_SSSE3_RUNTIME
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "protenc.h"
+#include "protenc_any_state.h"
+
+namespace prot_enc {
+
+// Positions of the objects of a batch for which a transition is valid, and of
+// the ones for which it isn't. Keep it between batches to reuse the memory.
+struct BatchPartition {
+  std::vector<std::uint32_t> valid;
+  std::vector<std::uint32_t> invalid;
+  // The valid positions grouped by state, for transition_batch.
+  std::vector<std::uint32_t> by_state;
+};
+
+namespace internal {
+
+struct AnyStateAccess {
+  template <auto State, auto FunctionPointer, typename AnyStateType,
+            typename... Args>
+  static void transition_from(AnyStateType& object, const Args&... args) {
+    object.template transition_from<State, FunctionPointer>(args...);
+  }
+};
+
+// Table of the transition: entry i is 1 + the next state index from the state
+// index i, or 0 if the transition is not valid from there. The shuffles only
+// read the first 16 entries: the state indices are either below num_states
+// (at most 16) or the empty index, for which they return 0.
+template <typename AnyStateType, auto FunctionPointer>
+constexpr std::array<std::uint8_t, 256> shifted_next_state_indices = [] {
+  std::array<std::uint8_t, 256> result{};
+  for (std::size_t i = 0; i < 256; ++i) {
+    const std::uint8_t next =
+        AnyStateType::template next_state_indices<FunctionPointer>[i];
+    result[i] = next == AnyStateType::empty_index
+                    ? 0
+                    : static_cast<std::uint8_t>(next + 1);
+  }
+  return result;
+}();
+
+#if defined(PROTENC_BATCH_SSSE3)
+#if defined(PROTENC_BATCH_SSSE3_RUNTIME)
+__attribute__((target("ssse3")))
+#endif
+inline void lookup_16_ssse3(const std::uint8_t* table,
+                            const std::uint8_t* state_indices,
+                            std::uint8_t* next) {
+  const __m128i lookup =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(table));
+  const __m128i indices =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(state_indices));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(next),
+                   _mm_shuffle_epi8(lookup, indices));
+}
+
+inline bool has_ssse3() {
+#if defined(PROTENC_BATCH_SSSE3_RUNTIME)
+  static const bool supported = __builtin_cpu_supports("ssse3");
+  return supported;
+#else
+  return true;
+#endif
+}
+#endif
+
+// next[i] = table[state_indices[i]] for the 16 state indices. `simd` tells
+// whether the vector lookup can be used (see has_ssse3).
+template <std::size_t NumStates>
+inline void lookup_16(const std::array<std::uint8_t, 256>& table,
+                      const std::uint8_t* state_indices, std::uint8_t* next,
+                      [[maybe_unused]] bool simd) {
+  // The shuffle tables only hold 16 entries.
+  if constexpr (NumStates <= 16) {
+#if defined(PROTENC_BATCH_SSSE3)
+    if (simd) return lookup_16_ssse3(table.data(), state_indices, next);
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    return vst1q_u8(next, vqtbl1q_u8(vld1q_u8(table.data()),
+                                     vld1q_u8(state_indices)));
+#endif
+  }
+  for (int i = 0; i < 16; ++i) next[i] = table[state_indices[i]];
+}
+
+// Take the transition on the objects at the positions, all in the state of
+// index StateIndex.
+template <typename AnyStateType, std::size_t StateIndex, auto FunctionPointer,
+          typename... Args>
+void transition_group(AnyStateType* objects, const std::uint32_t* positions,
+                      std::size_t count, const Args&... args) {
+  constexpr auto state = AnyStateType::Protocol::states[StateIndex];
+  for (std::size_t i = 0; i < count; ++i) {
+    AnyStateAccess::transition_from<state, FunctionPointer>(
+        objects[positions[i]], args...);
+  }
+}
+
+template <typename AnyStateType, auto FunctionPointer, typename... Args>
+using TransitionGroup = void (*)(AnyStateType*, const std::uint32_t*,
+                                 std::size_t, const Args&...);
+
+template <typename AnyStateType, auto FunctionPointer, typename... Args,
+          std::size_t... I>
+constexpr auto make_transition_groups(std::index_sequence<I...>) {
+  using Protocol = typename AnyStateType::Protocol;
+  constexpr std::size_t method =
+      Protocol::template method_index<FunctionPointer>;
+  // nullptr where the transition is not valid: no valid position is in these
+  // states.
+  return std::array<TransitionGroup<AnyStateType, FunctionPointer, Args...>,
+                    sizeof...(I)>{[] {
+    if constexpr (Protocol::next_state_index(I, method) ==
+                  Protocol::num_states) {
+      return TransitionGroup<AnyStateType, FunctionPointer, Args...>{nullptr};
+    } else {
+      return &transition_group<AnyStateType, I, FunctionPointer, Args...>;
+    }
+  }()...};
+}
+
+// The function taking the transition on a group of objects, by state index.
+template <typename AnyStateType, auto FunctionPointer, typename... Args>
+constexpr auto transition_groups =
+    make_transition_groups<AnyStateType, FunctionPointer, Args...>(
+        std::make_index_sequence<AnyStateType::num_states>());
+
+} // namespace internal
+
+// Split the objects into the positions where the transition FunctionPointer
+// is valid and the ones where it isn't.
+template <auto FunctionPointer, typename AnyWrapper>
+void partition_batch(std::span<const AnyState<AnyWrapper>> objects,
+                     BatchPartition& partition) {
+  using AnyStateType = AnyState<AnyWrapper>;
+  constexpr const auto& table =
+      internal::shifted_next_state_indices<AnyStateType, FunctionPointer>;
+  partition.valid.resize(objects.size());
+  partition.invalid.resize(objects.size());
+  std::size_t num_valid = 0;
+  std::size_t num_invalid = 0;
+  // Write every position to both lists, only advancing in the right one.
+  auto add = [&](std::size_t position, bool valid) {
+    partition.valid[num_valid] = static_cast<std::uint32_t>(position);
+    partition.invalid[num_invalid] = static_cast<std::uint32_t>(position);
+    num_valid += valid;
+    num_invalid += !valid;
+  };
+#if defined(PROTENC_BATCH_SSSE3)
+  const bool simd = internal::has_ssse3();
+#else
+  const bool simd = true;
+#endif
+  std::size_t base = 0;
+  for (; base + 16 <= objects.size(); base += 16) {
+    alignas(16) std::uint8_t state_indices[16];
+    for (int i = 0; i < 16; ++i) {
+      state_indices[i] = objects[base + i].state_index();
+    }
+    alignas(16) std::uint8_t next[16];
+    internal::lookup_16<AnyStateType::num_states>(table, state_indices, next,
+                                                  simd);
+    for (int i = 0; i < 16; ++i) add(base + i, next[i] != 0);
+  }
+  for (; base < objects.size(); ++base) {
+    add(base, table[objects[base].state_index()] != 0);
+  }
+  partition.valid.resize(num_valid);
+  partition.invalid.resize(num_invalid);
+}
+
+// Take the transition FunctionPointer on every object of the batch where it is
+// valid, with the same arguments. The positions of the other objects are left
+// in partition.invalid. Returns the number of transitions taken.
+template <auto FunctionPointer, typename AnyWrapper, typename... Args>
+std::size_t transition_batch(std::span<AnyState<AnyWrapper>> objects,
+                             BatchPartition& partition, const Args&... args) {
+  using AnyStateType = AnyState<AnyWrapper>;
+  constexpr std::size_t num_states = AnyStateType::num_states;
+  partition_batch<FunctionPointer, AnyWrapper>(objects, partition);
+
+  // Group the valid positions by state (counting sort).
+  std::array<std::size_t, num_states + 1> group_start{};
+  for (std::uint32_t position : partition.valid) {
+    ++group_start[objects[position].state_index() + 1];
+  }
+  for (std::size_t state = 0; state < num_states; ++state) {
+    group_start[state + 1] += group_start[state];
+  }
+  std::array<std::size_t, num_states> group_end;
+  for (std::size_t state = 0; state < num_states; ++state) {
+    group_end[state] = group_start[state];
+  }
+  partition.by_state.resize(partition.valid.size());
+  for (std::uint32_t position : partition.valid) {
+    partition.by_state[group_end[objects[position].state_index()]++] =
+        position;
+  }
+
+  constexpr const auto& groups =
+      internal::transition_groups<AnyStateType, FunctionPointer, Args...>;
+  for (std::size_t state = 0; state < num_states; ++state) {
+    const std::size_t size = group_start[state + 1] - group_start[state];
+    if (size == 0) continue;
+    groups[state](objects.data(),
+                  partition.by_state.data() + group_start[state], size,
+                  args...);
+  }
+  return partition.valid.size();
+}
+
+} // namespace prot_enc
+
+#endif // PROTENC_BATCH_H_
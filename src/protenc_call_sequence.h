@@ -0,0 +1,183 @@
+/**********************************
+ * MIT License (see LICENSE).     *
+ *                                *
+ * Copyright (c) 2019 nitnelave   *
+ *                                *
+ **********************************
+ *
+ *
+ * ProtEnc -- Compiled call sequences
+ *
+ * Some call sequences are only known at runtime (e.g. read from a
+ * configuration), but still have to follow the protocol. A CallSequence is
+ * checked against the transition table once, when it is compiled, into an
+ * array of pre-resolved instructions: each one holds the function calling the
+ * wrapped member function from its state, and its arguments. Running the
+ * sequence then costs no check at all: a loop calls the function of each
+ * instruction in turn.
+ **/
+
+#ifndef PROTENC_CALL_SEQUENCE_H_
+#define PROTENC_CALL_SEQUENCE_H_
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <tuple>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "protenc.h"
+
+namespace prot_enc {
+
+// Sequence of transitions of the protocol of AnyWrapper (the wrapper in any
+// state of the protocol), e.g.:
+//   using Sequence =
+//       CallSequence<HTTPConnectionBuilderWrapper<HTTPBuilderState::START>>;
+//   std::vector<Sequence::Step> steps = ...;  // From the configuration.
+//   std::optional<Sequence> sequence =
+//       Sequence::compile(HTTPBuilderState::START, std::move(steps));
+//   if (!sequence) { /* The steps don't follow the protocol. */ }
+//   std::optional<Wrapper<HTTPBuilderState::BODY>> builder =
+//       sequence->run<HTTPBuilderState::BODY>(GetConnectionBuilder());
+// The hooks of the policy of the wrapper are called for every transition.
+template <typename AnyWrapper>
+class CallSequence {
+ public:
+  using Protocol = typename AnyWrapper::Protocol;
+  using State = typename Protocol::State;
+  using Wrapped = typename Protocol::Wrapped;
+  template <State S>
+  using Wrapper = typename Protocol::template Wrapper<S>;
+
+  static constexpr std::size_t num_states = Protocol::num_states;
+  static constexpr std::size_t num_methods = Protocol::num_methods;
+  static_assert(num_methods > 0, "The protocol has no transitions");
+
+  // One call of the sequence. The index of the alternative of the variant is
+  // the method index (see Protocol::method_index), e.g.:
+  //   Step(std::in_place_index<method>, arguments...)
+  using Step = internal::method_arguments_variant<Protocol>;
+
+  // Check that the steps follow the protocol from the state `start`, and
+  // resolve them into instructions. Returns std::nullopt otherwise, with the
+  // position of the first invalid step in `invalid_step` (if given).
+  static std::optional<CallSequence> compile(
+      State start, std::vector<Step> steps,
+      std::size_t* invalid_step = nullptr) {
+    std::size_t state_index = Protocol::index_of(start);
+    if (state_index == Protocol::num_states) {
+      if (invalid_step != nullptr) *invalid_step = 0;
+      return std::nullopt;
+    }
+    CallSequence sequence(start, std::move(steps));
+    sequence.instructions_.reserve(sequence.steps_.size());
+    for (std::size_t i = 0; i < sequence.steps_.size(); ++i) {
+      const Step& step = sequence.steps_[i];
+      const std::size_t next_state_index =
+          Protocol::next_state_index(state_index, step.index());
+      if (next_state_index == num_states) [[unlikely]] {
+        if (invalid_step != nullptr) *invalid_step = i;
+        return std::nullopt;
+      }
+      sequence.instructions_.push_back(Instruction{
+          executors[state_index * num_methods + step.index()], &step});
+      state_index = next_state_index;
+    }
+    sequence.end_ = Protocol::states[state_index];
+    return sequence;
+  }
+
+  // Only moves: the instructions point to the steps.
+  CallSequence(CallSequence&&) = default;
+  CallSequence& operator=(CallSequence&&) = default;
+  CallSequence(const CallSequence&) = delete;
+  CallSequence& operator=(const CallSequence&) = delete;
+
+  State start_state() const { return start_; }
+  State end_state() const { return end_; }
+  std::size_t size() const { return steps_.size(); }
+
+  // Run the sequence on the wrapper, and return it in the state End. Returns
+  // std::nullopt (without running anything, and destroying the wrapper) if
+  // the wrapper is not in the start state of the sequence, or End is not its
+  // end state.
+  template <State End, typename W>
+  std::optional<Wrapper<End>> run(W wrapper) const {
+    static_assert(std::is_same_v<typename W::Protocol, Protocol>,
+                  "The wrapper does not follow the protocol of the sequence");
+    if (W::state != start_ || End != end_) [[unlikely]] return std::nullopt;
+    auto object = internal::WrapperAccess::take(wrapper);
+    for (const Instruction& instruction : instructions_) {
+      instruction.execute(object, *instruction.step);
+    }
+    return internal::WrapperAccess::make<Wrapper<End>>(std::move(object));
+  }
+
+ private:
+  using Stored = internal::StoredObject<Protocol>;
+
+  struct Instruction {
+    // Call the function of this instruction, from its state.
+    void (*execute)(Stored&, const Step&);
+    // The Step holding the arguments.
+    const Step* step;
+  };
+
+  CallSequence(State start, std::vector<Step> steps)
+      : start_(start), end_(start), steps_(std::move(steps)) {}
+
+  // Take the transition of the method from the state of index StateIndex.
+  template <std::size_t StateIndex, std::size_t Method>
+  static void execute(Stored& object, const Step& step) {
+    constexpr State from = Protocol::states[StateIndex];
+    constexpr State to =
+        Protocol::states[Protocol::next_state_index(StateIndex, Method)];
+    constexpr auto function = Protocol::template method<Method>;
+    Protocol::Policy::template on_transition<Protocol, from, to, function>(
+        object.slot, [&] {
+          std::apply(
+              [&](const auto&... args) {
+                internal::call_transition_function<
+                    typename Protocol::Transitions, from, function>(
+                    internal::object_of(object.wrapped), args...);
+              },
+              *std::get_if<Method>(&step));
+        });
+  }
+
+  using Executor = void (*)(Stored&, const Step&);
+
+  template <std::size_t Edge>
+  static constexpr Executor executor() {
+    constexpr std::size_t state = Edge / num_methods;
+    constexpr std::size_t method = Edge % num_methods;
+    if constexpr (Protocol::next_state_index(state, method) == num_states) {
+      return nullptr;
+    } else {
+      return &execute<state, method>;
+    }
+  }
+
+  template <std::size_t... Edge>
+  static constexpr std::array<Executor, num_states * num_methods>
+  make_executors(std::index_sequence<Edge...>) {
+    return {executor<Edge>()...};
+  }
+
+  // The function taking each transition, indexed by state * num_methods +
+  // method (nullptr where it is not valid).
+  static constexpr std::array<Executor, num_states * num_methods> executors =
+      make_executors(std::make_index_sequence<num_states * num_methods>());
+
+  State start_;
+  State end_;
+  std::vector<Step> steps_;
+  std::vector<Instruction> instructions_;
+};
+
+} // namespace prot_enc
+
+#endif // PROTENC_CALL_SEQUENCE_H_
@@ -0,0 +1,218 @@
+/**********************************
+ * MIT License (see LICENSE).     *
+ *                                *
+ * Copyright (c) 2019 nitnelave   *
+ *                                *
+ **********************************
+ *
+ *
+ * ProtEnc -- Census of the live objects by state
+ *
+ * The CensusPolicy keeps the number of objects of the protocol alive in each
+ * state, e.g. to spot requests stuck in HEADERS, and the number of objects
+ * destroyed in each state without a final transition. The counters are per
+ * thread (an object created in a thread and dropped in another one adds 1 to
+ * the first, and -1 to the second), and summed on read, by ProtocolCensus or
+ * by the export of the metrics (see protenc_metrics.h):
+ *   protenc_live_objects{protocol="Request",state="HEADERS"} 3
+ **/
+
+#ifndef PROTENC_CENSUS_H_
+#define PROTENC_CENSUS_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+#include "protenc.h"
+#include "protenc_metrics.h"
+
+namespace prot_enc {
+
+namespace internal {
+
+// The census of the objects of the protocol in one thread.
+template <typename Protocol>
+struct CensusCounters {
+  static constexpr std::size_t num_states = Protocol::num_states;
+  using Names = NamesOf<Protocol>;
+
+  // Indexed by state: objects entering the state minus objects leaving it.
+  std::array<std::atomic<std::int64_t>, num_states> live{};
+  // Indexed by state.
+  std::array<std::atomic<std::uint64_t>, num_states> abandoned{};
+
+  static CensusCounters& local() {
+    return ThreadBlocks<CensusCounters>::local();
+  }
+
+  struct Totals {
+    std::array<std::int64_t, num_states> live{};
+    std::array<std::uint64_t, num_states> abandoned{};
+  };
+
+  static Totals totals() {
+    Totals totals;
+    ThreadBlocks<CensusCounters>::for_each([&](const CensusCounters& counters) {
+      for (std::size_t state = 0; state < num_states; ++state) {
+        totals.live[state] +=
+            counters.live[state].load(std::memory_order_relaxed);
+        totals.abandoned[state] +=
+            counters.abandoned[state].load(std::memory_order_relaxed);
+      }
+    });
+    return totals;
+  }
+
+  static void register_metrics() {
+    MetricsExporter::add({"protenc_live_objects", "gauge",
+                          "Objects alive, by state."},
+                         &write_live);
+    MetricsExporter::add(
+        {"protenc_abandoned_objects", "counter",
+         "Objects destroyed before their final transition, by state."},
+        &write_abandoned);
+  }
+
+  static void write_live(std::string& out) {
+    const Totals all = totals();
+    for (std::size_t state = 0; state < num_states; ++state) {
+      append_sample(out, "protenc_live_objects", state_labels(state),
+                    all.live[state]);
+    }
+  }
+
+  static void write_abandoned(std::string& out) {
+    const Totals all = totals();
+    for (std::size_t state = 0; state < num_states; ++state) {
+      append_sample(out, "protenc_abandoned_objects_total",
+                    state_labels(state), all.abandoned[state]);
+    }
+  }
+
+  static std::string state_labels(std::size_t state) {
+    return render_labels({{"protocol", Names::protocol_name},
+                          {"state", Names::state_name_at(state)}});
+  }
+};
+
+} // namespace internal
+
+// Policy keeping the census of the objects of the protocol, to read with
+// ProtocolCensus or export with WriteOpenMetrics, e.g.:
+//   PROTENC_START_WRAPPER_WITH_POLICY(RequestWrapper, Request, ...,
+//                                     prot_enc::CensusPolicy);
+// An object leaves the census with its final transition, or when it is
+// destroyed (then counted as abandoned in its state). The objects stored in a
+// StatePool or an AnyState keep their Slot, and are counted in their state.
+struct CensusPolicy : DefaultPolicy {
+  // Whether the wrapper holds an object of the census: not after it was moved
+  // from, nor after its final transition.
+  struct Slot {
+    Slot() = default;
+    Slot(Slot&& other) : counted(other.counted) { other.counted = false; }
+    Slot& operator=(Slot&& other) {
+      counted = other.counted;
+      other.counted = false;
+      return *this;
+    }
+
+    bool counted = false;
+  };
+
+  template <typename Protocol, auto State>
+  static void on_construct(Slot& slot) {
+    internal::add_relaxed(
+        internal::CensusCounters<Protocol>::local()
+            .live[Protocol::template index_of_v<State>],
+        std::int64_t{1});
+    slot.counted = true;
+  }
+
+  template <typename Protocol, auto From, auto To, auto FunctionPointer,
+            typename Call>
+  static void on_transition(Slot& slot, Call&& call) {
+    call();
+    if constexpr (From != To) {
+      if (!slot.counted) return;
+      auto& counters = internal::CensusCounters<Protocol>::local();
+      internal::add_relaxed(counters.live[Protocol::template index_of_v<From>],
+                            std::int64_t{-1});
+      internal::add_relaxed(counters.live[Protocol::template index_of_v<To>],
+                            std::int64_t{1});
+    }
+  }
+
+  template <typename Protocol, auto From, auto FunctionPointer, typename Call>
+  static decltype(auto) on_final_transition(Slot& slot,
+                                            typename Protocol::Wrapped&,
+                                            Call&& call) {
+    if constexpr (std::is_void_v<decltype(call())>) {
+      call();
+      leave<Protocol, From>(slot);
+    } else {
+      decltype(auto) result = call();
+      leave<Protocol, From>(slot);
+      return result;
+    }
+  }
+
+  template <typename Protocol, auto State>
+  static void on_destroy(Slot& slot) {
+    if (!slot.counted) return;
+    auto& counters = internal::CensusCounters<Protocol>::local();
+    internal::add_relaxed(counters.live[Protocol::template index_of_v<State>],
+                          std::int64_t{-1});
+    internal::add_relaxed(
+        counters.abandoned[Protocol::template index_of_v<State>],
+        std::uint64_t{1});
+    slot.counted = false;
+  }
+
+ private:
+  template <typename Protocol, auto State>
+  static void leave(Slot& slot) {
+    if (!slot.counted) return;
+    internal::add_relaxed(internal::CensusCounters<Protocol>::local()
+                              .live[Protocol::template index_of_v<State>],
+                          std::int64_t{-1});
+    slot.counted = false;
+  }
+};
+
+// The census of the protocol of AnyWrapper (a wrapper in any state), kept by
+// the CensusPolicy. Each read sums the counters of all the threads, e.g.:
+//   using Census = prot_enc::ProtocolCensus<RequestWrapper<RequestState::NEW>>;
+//   if (Census::live(RequestState::HEADERS) > 1000) ...
+template <typename AnyWrapper>
+class ProtocolCensus {
+ public:
+  using Protocol = typename AnyWrapper::Protocol;
+  using State = typename Protocol::State;
+  static constexpr std::size_t num_states = Protocol::num_states;
+
+  // Objects alive in the state.
+  static std::int64_t live(State state) {
+    return Counters::totals().live[Protocol::index_of(state)];
+  }
+
+  // Objects destroyed in the state, without a final transition.
+  static std::uint64_t abandoned(State state) {
+    return Counters::totals().abandoned[Protocol::index_of(state)];
+  }
+
+  // Objects alive in each state, indexed like Protocol::states.
+  static std::array<std::int64_t, num_states> live_by_state() {
+    return Counters::totals().live;
+  }
+
+ private:
+  using Counters = internal::CensusCounters<Protocol>;
+};
+
+} // namespace prot_enc
+
+#endif // PROTENC_CENSUS_H_
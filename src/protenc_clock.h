@@ -0,0 +1,96 @@
+/**********************************
+ * MIT License (see LICENSE).     *
+ *                                *
+ * Copyright (c) 2019 nitnelave   *
+ *                                *
+ **********************************
+ *
+ *
+ * ProtEnc -- Cheap timestamps
+ *
+ * The instrumentation policies take a timestamp on every transition they
+ * measure. TscClock reads the CPU's timestamp counter (rdtsc on x86, the
+ * virtual counter on AArch64), a few nanoseconds without a syscall or a vDSO
+ * call, and converts the ticks to nanoseconds with a rate calibrated once, at
+ * startup, so that the first measured transition doesn't pay for it.
+ **/
+
+#ifndef PROTENC_CLOCK_H_
+#define PROTENC_CLOCK_H_
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace prot_enc {
+
+// Clock of the timestamp counter. On x86, the counter must be invariant
+// (constant rate, in sync across cores), as on any recent CPU. Elsewhere, it
+// falls back to std::chrono::steady_clock.
+struct TscClock {
+  static std::uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    std::uint64_t ticks;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    return steady_now_ns();
+#endif
+  }
+
+  // Calibrated before main (see tsc_ns_per_tick below): not to be used by the
+  // initializers of other static variables.
+  static double ns_per_tick();
+
+  static std::uint64_t to_ns(std::uint64_t ticks) {
+    return static_cast<std::uint64_t>(static_cast<double>(ticks) *
+                                      ns_per_tick());
+  }
+
+  // Measure the rate of the counter: about 1 ms on x86.
+  static double calibrate() {
+#if defined(__x86_64__) || defined(__i386__)
+    // Count the ticks during 1 ms of the steady clock.
+    const std::uint64_t start_ns = steady_now_ns();
+    const std::uint64_t start_ticks = now();
+    std::uint64_t end_ns;
+    do {
+      end_ns = steady_now_ns();
+    } while (end_ns - start_ns < 1000000);
+    const std::uint64_t end_ticks = now();
+    return static_cast<double>(end_ns - start_ns) /
+           static_cast<double>(end_ticks - start_ticks);
+#elif defined(__aarch64__)
+    std::uint64_t frequency;
+    asm volatile("mrs %0, cntfrq_el0" : "=r"(frequency));
+    return 1e9 / static_cast<double>(frequency);
+#else
+    return 1.0;
+#endif
+  }
+
+ private:
+  static std::uint64_t steady_now_ns() {
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+  }
+};
+
+namespace internal {
+// The rate of TscClock, calibrated once at startup, in the static
+// initialization of the program.
+inline const double tsc_ns_per_tick = TscClock::calibrate();
+} // namespace internal
+
+inline double TscClock::ns_per_tick() { return internal::tsc_ns_per_tick; }
+
+} // namespace prot_enc
+
+#endif // PROTENC_CLOCK_H_
@@ -0,0 +1,230 @@
+/**********************************
+ * MIT License (see LICENSE).     *
+ *                                *
+ * Copyright (c) 2019 nitnelave   *
+ *                                *
+ **********************************
+ *
+ *
+ * ProtEnc -- Batched event dispatch
+ *
+ * Execute a stream of events (object handle, method, arguments) on the objects
+ * of a StatePool. Instead of dispatching every event on its own, the events are
+ * grouped by (current state, method) using the transition table of the
+ * protocol: the invalid ones are rejected in bulk, and each valid group is
+ * executed in a loop through the typed call_transition of its state.
+ **/
+
+#ifndef PROTENC_DISPATCH_H_
+#define PROTENC_DISPATCH_H_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "protenc.h"
+#include "protenc_state_pool.h"
+
+namespace prot_enc {
+
+// Dispatcher for the events of the objects of a StatePool<AnyWrapper>. It keeps
+// scratch buffers between batches, so it should be reused.
+template <typename AnyWrapper>
+class EventDispatcher {
+ public:
+  using Pool = StatePool<AnyWrapper>;
+  using Protocol = typename Pool::Protocol;
+  using State = typename Protocol::State;
+
+  static constexpr std::size_t num_states = Protocol::num_states;
+  static constexpr std::size_t num_methods = Protocol::num_methods;
+  static_assert(num_methods > 0, "The protocol has no transitions");
+
+  // Arguments of an event. The index of the alternative is the method index
+  // (see Protocol::method_index).
+  using Arguments = internal::method_arguments_variant<Protocol>;
+
+  struct Event {
+    PoolHandle handle;
+    Arguments arguments;
+
+    std::size_t method() const { return arguments.index(); }
+  };
+
+  // Create an event calling the transition function FunctionPointer. For
+  // methods only known at runtime, build the Arguments with
+  // std::in_place_index<method_index>.
+  template <auto FunctionPointer, typename... Args>
+  static Event make_event(PoolHandle handle, Args&&... args) {
+    constexpr std::size_t method =
+        Protocol::template method_index<FunctionPointer>;
+    static_assert(method < num_methods,
+                  "The function is not a transition of the protocol");
+    return Event{handle, Arguments(std::in_place_index<method>,
+                                   std::forward<Args>(args)...)};
+  }
+
+  // Execute the events on the objects of the pool. The arguments are moved out
+  // of the events. The events of an object are executed in order: the batch is
+  // split in waves, where the wave N holds the N-th event of each object.
+  // The positions of the events that are not valid in the state of their
+  // object, or whose object is not in the pool (anymore), are appended to
+  // `rejected`. Returns the number of events executed.
+  std::size_t dispatch(Pool& pool, std::vector<Event>& events,
+                       std::vector<std::size_t>& rejected) {
+    // Sort the events by wave.
+    events_per_handle_.assign(pool.handle_limit(), 0);
+    wave_of_event_.resize(events.size());
+    std::size_t num_waves = 0;
+    for (std::size_t i = 0; i < events.size(); ++i) {
+      const std::uint32_t index = events[i].handle.index;
+      // A handle that the pool never gave out: stale.
+      if (index >= events_per_handle_.size()) [[unlikely]] {
+        wave_of_event_[i] = kNoWave;
+        rejected.push_back(i);
+        continue;
+      }
+      const std::uint32_t wave = events_per_handle_[index]++;
+      wave_of_event_[i] = wave;
+      num_waves = std::max<std::size_t>(num_waves, wave + 1);
+    }
+    wave_start_.assign(num_waves + 1, 0);
+    for (std::uint32_t wave : wave_of_event_) {
+      if (wave != kNoWave) ++wave_start_[wave + 1];
+    }
+    for (std::size_t wave = 0; wave < num_waves; ++wave) {
+      wave_start_[wave + 1] += wave_start_[wave];
+    }
+    by_wave_.resize(wave_start_[num_waves]);
+    group_end_.assign(wave_start_.begin(), wave_start_.end() - 1);
+    for (std::size_t i = 0; i < events.size(); ++i) {
+      if (wave_of_event_[i] == kNoWave) continue;
+      by_wave_[group_end_[wave_of_event_[i]]++] =
+          static_cast<std::uint32_t>(i);
+    }
+
+    std::size_t executed = 0;
+    for (std::size_t wave = 0; wave < num_waves; ++wave) {
+      executed += dispatch_wave(pool, events,
+                                by_wave_.data() + wave_start_[wave],
+                                wave_start_[wave + 1] - wave_start_[wave],
+                                rejected);
+    }
+    return executed;
+  }
+
+ private:
+  // Executes the events (given by position) that are all in the group
+  // (state, method) of the function.
+  using GroupFunction = void (*)(Pool&, Event*, const std::uint32_t*,
+                                 std::size_t);
+
+  static constexpr std::size_t num_groups = num_states * num_methods;
+  // Group of the events of the objects that left the pool.
+  static constexpr std::uint32_t kStaleHandle = num_groups;
+  // Wave of the events of the handles out of the range of the pool.
+  static constexpr std::uint32_t kNoWave = UINT32_MAX;
+
+  template <std::size_t Group>
+  static void run_group(Pool& pool, Event* events,
+                        const std::uint32_t* positions, std::size_t count) {
+    constexpr std::size_t method = Group % num_methods;
+    constexpr State state = Protocol::states[Group / num_methods];
+    for (std::size_t i = 0; i < count; ++i) {
+      Event& event = events[positions[i]];
+      std::apply(
+          [&](auto&... args) {
+            pool.template transition<state, Protocol::template method<method>>(
+                event.handle, std::move(args)...);
+          },
+          *std::get_if<method>(&event.arguments));
+    }
+  }
+
+  template <std::size_t Group>
+  static constexpr GroupFunction group_function() {
+    if constexpr (Protocol::next_state_index(Group / num_methods,
+                                             Group % num_methods) ==
+                  num_states) {
+      return nullptr;
+    } else {
+      return &run_group<Group>;
+    }
+  }
+
+  template <std::size_t... Group>
+  static constexpr std::array<GroupFunction, num_groups> make_group_functions(
+      std::index_sequence<Group...>) {
+    return {group_function<Group>()...};
+  }
+
+  // The function executing each (state, method) group, or nullptr for the
+  // invalid transitions.
+  static constexpr std::array<GroupFunction, num_groups> group_functions =
+      make_group_functions(std::make_index_sequence<num_groups>());
+
+  // Execute events that are all on different objects.
+  std::size_t dispatch_wave(Pool& pool, std::vector<Event>& events,
+                            const std::uint32_t* positions, std::size_t count,
+                            std::vector<std::size_t>& rejected) {
+    // Sort the events by group, rejecting the invalid ones.
+    group_of_event_.resize(count);
+    group_start_.assign(num_groups + 1, 0);
+    for (std::size_t i = 0; i < count; ++i) {
+      const Event& event = events[positions[i]];
+      if (!pool.contains(event.handle)) [[unlikely]] {
+        group_of_event_[i] = kStaleHandle;
+        rejected.push_back(positions[i]);
+        continue;
+      }
+      const std::size_t group =
+          pool.state_index_of(event.handle) * num_methods + event.method();
+      group_of_event_[i] = static_cast<std::uint32_t>(group);
+      ++group_start_[group + 1];
+    }
+    for (std::size_t group = 0; group < num_groups; ++group) {
+      group_start_[group + 1] += group_start_[group];
+    }
+    by_group_.resize(count);
+    group_end_.assign(group_start_.begin(), group_start_.end() - 1);
+    for (std::size_t i = 0; i < count; ++i) {
+      if (group_of_event_[i] == kStaleHandle) continue;
+      by_group_[group_end_[group_of_event_[i]]++] = positions[i];
+    }
+
+    std::size_t executed = 0;
+    for (std::size_t group = 0; group < num_groups; ++group) {
+      const std::size_t begin = group_start_[group];
+      const std::size_t size = group_start_[group + 1] - begin;
+      if (size == 0) continue;
+      if (group_functions[group] == nullptr) [[unlikely]] {
+        rejected.insert(rejected.end(), by_group_.begin() + begin,
+                        by_group_.begin() + begin + size);
+      } else {
+        group_functions[group](pool, events.data(), by_group_.data() + begin,
+                               size);
+        executed += size;
+      }
+    }
+    return executed;
+  }
+
+  // Scratch buffers.
+  std::vector<std::uint32_t> events_per_handle_;
+  std::vector<std::uint32_t> wave_of_event_;
+  std::vector<std::size_t> wave_start_;
+  std::vector<std::uint32_t> by_wave_;
+  std::vector<std::uint32_t> group_of_event_;
+  std::vector<std::size_t> group_start_;
+  std::vector<std::size_t> group_end_;
+  std::vector<std::uint32_t> by_group_;
+};
+
+} // namespace prot_enc
+
+#endif // PROTENC_DISPATCH_H_
@@ -0,0 +1,147 @@
+/**********************************
+ * MIT License (see LICENSE).     *
+ *                                *
+ * Copyright (c) 2019 nitnelave   *
+ *                                *
+ **********************************
+ *
+ *
+ * ProtEnc -- Time spent in each state
+ *
+ * The MetricsPolicy measures how long the transitions take, but not how long
+ * the objects wait in a state between two transitions (e.g. a request in
+ * HEADERS, waiting for its body). The DwellTimePolicy timestamps the entry of
+ * the object in each state, in its Slot, and records the time spent in the
+ * state when the object leaves it, in a histogram per state exported with the
+ * other metrics (see protenc_metrics.h).
+ **/
+
+#ifndef PROTENC_DWELL_H_
+#define PROTENC_DWELL_H_
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+#include "protenc.h"
+#include "protenc_clock.h"
+#include "protenc_metrics.h"
+
+namespace prot_enc {
+
+namespace internal {
+
+// The dwell times of the objects of the protocol in one thread.
+template <typename Protocol>
+struct ProtocolDwellTimes {
+  using Names = NamesOf<Protocol>;
+
+  // Indexed by state.
+  std::array<LatencyHistogram, Protocol::num_states> states;
+
+  static ProtocolDwellTimes& local() {
+    return ThreadBlocks<ProtocolDwellTimes>::local();
+  }
+
+  static void register_metrics() {
+    MetricsExporter::add(
+        {"protenc_state_dwell_seconds", "histogram",
+         "Time spent by the objects in each state, until they leave it."},
+        &write_dwell_times);
+  }
+
+  static void write_dwell_times(std::string& out) {
+    std::array<LatencyHistogram::Snapshot, Protocol::num_states> snapshots{};
+    ThreadBlocks<ProtocolDwellTimes>::for_each(
+        [&](const ProtocolDwellTimes& dwell_times) {
+          for (std::size_t state = 0; state < Protocol::num_states; ++state) {
+            dwell_times.states[state].add_to(snapshots[state]);
+          }
+        });
+    for (std::size_t state = 0; state < Protocol::num_states; ++state) {
+      LatencyHistogram::append(
+          out, "protenc_state_dwell_seconds", snapshots[state],
+          render_labels({{"protocol", Names::protocol_name},
+                         {"state", Names::state_name_at(state)}}));
+    }
+  }
+};
+
+} // namespace internal
+
+// Policy measuring the time the objects spend in each state, to export with
+// WriteOpenMetrics, e.g. along with the other metrics:
+//   PROTENC_START_WRAPPER_WITH_POLICY(
+//       RequestWrapper, Request, ...,
+//       prot_enc::Policies<prot_enc::MetricsPolicy,
+//                          prot_enc::DwellTimePolicy>);
+// A transition from a state to itself doesn't leave the state: it is not
+// measured at all. The time in the last state ends with the final transition,
+// or with the destruction of the object if it never took one.
+struct DwellTimePolicy : DefaultPolicy {
+  // When the object entered its state, in TscClock ticks (0 for none). The
+  // moved-from wrapper has no object.
+  struct Slot {
+    Slot() = default;
+    Slot(Slot&& other) : entered(other.entered) { other.entered = 0; }
+    Slot& operator=(Slot&& other) {
+      entered = other.entered;
+      other.entered = 0;
+      return *this;
+    }
+
+    std::uint64_t entered = 0;
+  };
+
+  template <typename Protocol, auto State>
+  static void on_construct(Slot& slot) {
+    slot.entered = TscClock::now();
+  }
+
+  template <typename Protocol, auto From, auto To, auto FunctionPointer,
+            typename Call>
+  static void on_transition(Slot& slot, Call&& call) {
+    call();
+    if constexpr (From != To) {
+      const std::uint64_t now = TscClock::now();
+      leave<Protocol, From>(slot, now);
+      slot.entered = now;
+    }
+  }
+
+  template <typename Protocol, auto From, auto FunctionPointer, typename Call>
+  static decltype(auto) on_final_transition(Slot& slot,
+                                            typename Protocol::Wrapped&,
+                                            Call&& call) {
+    if constexpr (std::is_void_v<decltype(call())>) {
+      call();
+      leave<Protocol, From>(slot, TscClock::now());
+      slot.entered = 0;
+    } else {
+      decltype(auto) result = call();
+      leave<Protocol, From>(slot, TscClock::now());
+      slot.entered = 0;
+      return result;
+    }
+  }
+
+  template <typename Protocol, auto State>
+  static void on_destroy(Slot& slot) {
+    leave<Protocol, State>(slot, TscClock::now());
+  }
+
+ private:
+  template <typename Protocol, auto State>
+  static void leave(const Slot& slot, std::uint64_t now) {
+    // Moved from, or after the final transition.
+    if (slot.entered == 0) return;
+    internal::ProtocolDwellTimes<Protocol>::local()
+        .states[Protocol::template index_of_v<State>]
+        .record(TscClock::to_ns(now - slot.entered));
+  }
+};
+
+} // namespace prot_enc
+
+#endif // PROTENC_DWELL_H_
@@ -0,0 +1,528 @@
+/**********************************
+ * MIT License (see LICENSE).     *
+ *                                *
+ * Copyright (c) 2019 nitnelave   *
+ *                                *
+ **********************************
+ *
+ *
+ * ProtEnc -- Protocol metrics in the OpenMetrics format
+ *
+ * The MetricsPolicy counts the objects created in each initial state, and the
+ * transitions taken along each edge (state, method) of the protocol, with a
+ * histogram of their latency. The counters are per thread, without any
+ * synchronization on the hot path, and are summed when exported. The export
+ * walks the compile-time table of the edges of every instrumented protocol,
+ * and labels the metrics with the protocol, state and method names (see
+ * protenc_names.h):
+ *   protenc_transitions_total{protocol="RequestBuilder",state="HEADERS",
+ *                             method="add_header"} 42
+ **/
+
+#ifndef PROTENC_METRICS_H_
+#define PROTENC_METRICS_H_
+
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "protenc.h"
+#include "protenc_names.h"
+
+namespace prot_enc {
+
+/******************************************************************************
+ *  EXPORT                                                                    *
+ ******************************************************************************/
+
+// A metric family of the OpenMetrics text format.
+struct MetricFamily {
+  // e.g. "protenc_transitions".
+  std::string_view name;
+  // "counter", "gauge" or "histogram".
+  std::string_view type;
+  std::string_view help;
+};
+
+namespace internal {
+
+// The metric families, and the functions writing their samples. The policies
+// register the families of each protocol they instrument the first time they
+// are used with it.
+class MetricsExporter {
+ public:
+  // Writes the samples of the family for one protocol.
+  using WriteSamples = void (*)(std::string&);
+
+  static void add(const MetricFamily& family, WriteSamples write_samples) {
+    std::lock_guard<std::mutex> lock(mutex());
+    for (Family& existing : families()) {
+      if (existing.family.name == family.name) {
+        existing.writers.push_back(write_samples);
+        return;
+      }
+    }
+    families().push_back(Family{family, {write_samples}});
+  }
+
+  // The samples of a family are written together, whatever the protocol.
+  static std::string text() {
+    std::string result;
+    std::lock_guard<std::mutex> lock(mutex());
+    for (const Family& family : families()) {
+      result.append("# TYPE ").append(family.family.name).append(" ");
+      result.append(family.family.type).append("\n");
+      result.append("# HELP ").append(family.family.name).append(" ");
+      result.append(family.family.help).append("\n");
+      for (WriteSamples write_samples : family.writers) write_samples(result);
+    }
+    result.append("# EOF\n");
+    return result;
+  }
+
+ private:
+  struct Family {
+    MetricFamily family;
+    std::vector<WriteSamples> writers;
+  };
+
+  static std::mutex& mutex() {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  static std::vector<Family>& families() {
+    static std::vector<Family> families;
+    return families;
+  }
+};
+
+// One Block per thread, and a walk over the blocks of all the threads. The
+// block of a thread that exited is given to the next new thread, so that the
+// cumulative counts are kept, and the memory is bounded by the number of
+// threads running at once.
+//
+// A Block is only written by its thread, through relaxed atomics (see
+// add_relaxed), and read by the export. Block::register_metrics(), if any, is
+// called with the first block.
+template <typename Block>
+class ThreadBlocks {
+ public:
+  static Block& local() {
+    thread_local Handle handle;
+    return *handle.block;
+  }
+
+  // Call f with every block, including the ones of the threads that exited.
+  template <typename F>
+  static void for_each(F&& f) {
+    std::lock_guard<std::mutex> lock(mutex());
+    for (const Entry& entry : entries()) {
+      f(static_cast<const Block&>(*entry.block));
+    }
+  }
+
+ private:
+  struct Entry {
+    std::unique_ptr<Block> block;
+    bool in_use;
+  };
+
+  struct Handle {
+    Handle() {
+      [[maybe_unused]] bool first;
+      {
+        std::lock_guard<std::mutex> lock(mutex());
+        first = entries().empty();
+        for (Entry& entry : entries()) {
+          if (!entry.in_use) {
+            entry.in_use = true;
+            block = entry.block.get();
+            break;
+          }
+        }
+        if (block == nullptr) {
+          entries().push_back(Entry{std::make_unique<Block>(), true});
+          block = entries().back().block.get();
+        }
+      }
+      // Outside of the lock: the export takes its lock, then ours.
+      if constexpr (requires { Block::register_metrics(); }) {
+        if (first) Block::register_metrics();
+      }
+    }
+
+    ~Handle() {
+      std::lock_guard<std::mutex> lock(mutex());
+      for (Entry& entry : entries()) {
+        if (entry.block.get() == block) entry.in_use = false;
+      }
+    }
+
+    Block* block = nullptr;
+  };
+
+  static std::mutex& mutex() {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  static std::vector<Entry>& entries() {
+    static std::vector<Entry> entries;
+    return entries;
+  }
+};
+
+// Add to a counter that only this thread writes: a plain load and store, no
+// locked instruction.
+template <typename T>
+void add_relaxed(std::atomic<T>& counter, T value) {
+  counter.store(counter.load(std::memory_order_relaxed) + value,
+                std::memory_order_relaxed);
+}
+
+inline void append_number(std::string& out, std::uint64_t value) {
+  char digits[24];
+  out.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+}
+
+inline void append_number(std::string& out, std::int64_t value) {
+  char digits[24];
+  out.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+}
+
+inline void append_number(std::string& out, double value) {
+  char digits[32];
+  out.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+}
+
+// Labels of a sample, rendered once for all its samples.
+struct Label {
+  std::string_view name;
+  std::string_view value;
+};
+
+// e.g. protocol="P",state="S". The names are C++ identifiers: there is
+// nothing to escape.
+inline std::string render_labels(std::initializer_list<Label> labels) {
+  std::string result;
+  for (const Label& label : labels) {
+    if (!result.empty()) result.push_back(',');
+    result.append(label.name).append("=\"").append(label.value).append("\"");
+  }
+  return result;
+}
+
+// "name{labels} value\n".
+template <typename Value>
+void append_sample(std::string& out, std::string_view name,
+                   std::string_view labels, Value value) {
+  out.append(name).append("{").append(labels).append("} ");
+  append_number(out, value);
+  out.push_back('\n');
+}
+
+template <typename Protocol>
+using NamesOf =
+    ProtocolNames<typename Protocol::template Wrapper<Protocol::states[0]>>;
+
+template <typename Clock>
+std::uint64_t elapsed_ns(typename Clock::time_point start) {
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                           start)
+          .count());
+}
+
+} // namespace internal
+
+// The metrics of every instrumented protocol, in the OpenMetrics text format,
+// e.g. for a pull endpoint.
+inline std::string OpenMetricsText() {
+  return internal::MetricsExporter::text();
+}
+
+// Write the metrics to the file descriptor. Returns whether all was written.
+inline bool WriteOpenMetrics(int fd) {
+  const std::string text = OpenMetricsText();
+  std::size_t written = 0;
+  while (written < text.size()) {
+    const ssize_t result =
+        ::write(fd, text.data() + written, text.size() - written);
+    if (result < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    written += static_cast<std::size_t>(result);
+  }
+  return true;
+}
+
+
+/******************************************************************************
+ *  LATENCY HISTOGRAM                                                         *
+ ******************************************************************************/
+
+// Latency histogram of one thread, with buckets growing by powers of 4: up to
+// 128 ns, 512 ns, ..., 8.6 s, and above.
+class LatencyHistogram {
+ public:
+  static constexpr std::size_t num_buckets = 15;
+
+  // Upper bound of the bucket, inclusive (except for the last one).
+  static constexpr std::uint64_t upper_bound_ns(std::size_t bucket) {
+    return std::uint64_t{128} << (2 * bucket);
+  }
+
+  static constexpr std::size_t bucket_of(std::uint64_t ns) {
+    // The bucket b > 0 holds (2^(5 + 2b), 2^(7 + 2b)].
+    const std::size_t width =
+        static_cast<std::size_t>(std::bit_width(ns - (ns != 0)));
+    if (width <= 7) return 0;
+    const std::size_t bucket = (width - 6) / 2;
+    return bucket < num_buckets ? bucket : num_buckets - 1;
+  }
+
+  // Record `count` durations of ns each (more than one for sampled
+  // measurements).
+  void record(std::uint64_t ns, std::uint64_t count = 1) {
+    internal::add_relaxed(buckets_[bucket_of(ns)], count);
+    internal::add_relaxed(sum_ns_, ns * count);
+  }
+
+  // The sum of the histograms of all the threads.
+  struct Snapshot {
+    std::array<std::uint64_t, num_buckets> buckets{};
+    std::uint64_t sum_ns = 0;
+
+    std::uint64_t count() const {
+      std::uint64_t result = 0;
+      for (std::uint64_t bucket : buckets) result += bucket;
+      return result;
+    }
+  };
+
+  void add_to(Snapshot& snapshot) const {
+    for (std::size_t i = 0; i < num_buckets; ++i) {
+      snapshot.buckets[i] += buckets_[i].load(std::memory_order_relaxed);
+    }
+    snapshot.sum_ns += sum_ns_.load(std::memory_order_relaxed);
+  }
+
+  // Write the samples of the histogram `name` (cumulative buckets, count and
+  // sum, in seconds) with the rendered labels.
+  static void append(std::string& out, std::string_view name,
+                     const Snapshot& snapshot, std::string_view labels) {
+    const std::string bucket_name = std::string(name) + "_bucket";
+    std::uint64_t cumulative = 0;
+    for (std::size_t i = 0; i < num_buckets; ++i) {
+      cumulative += snapshot.buckets[i];
+      std::string bucket_labels(labels);
+      bucket_labels.append(",le=\"");
+      if (i + 1 == num_buckets) {
+        bucket_labels.append("+Inf");
+      } else {
+        internal::append_number(bucket_labels, upper_bound_ns(i) / 1e9);
+      }
+      bucket_labels.push_back('"');
+      internal::append_sample(out, bucket_name, bucket_labels, cumulative);
+    }
+    internal::append_sample(out, std::string(name) + "_count", labels,
+                            snapshot.count());
+    internal::append_sample(out, std::string(name) + "_sum", labels,
+                            snapshot.sum_ns / 1e9);
+  }
+
+ private:
+  std::array<std::atomic<std::uint64_t>, num_buckets> buckets_{};
+  std::atomic<std::uint64_t> sum_ns_{0};
+};
+
+
+/******************************************************************************
+ *  METRICS POLICY                                                            *
+ ******************************************************************************/
+
+namespace internal {
+
+// The metrics of the protocol in one thread.
+template <typename Protocol>
+struct ProtocolMetrics {
+  static constexpr std::size_t num_states = Protocol::num_states;
+  static constexpr std::size_t num_methods = Protocol::num_methods;
+  static constexpr std::size_t num_final_methods = Protocol::num_final_methods;
+  using Names = NamesOf<Protocol>;
+
+  // The edges of the transitions are numbered state * num_methods + method,
+  // and then come the ones of the final transitions.
+  static constexpr std::size_t num_edges =
+      num_states * (num_methods + num_final_methods);
+
+  template <auto State, auto FunctionPointer>
+  static constexpr std::size_t transition_edge =
+      Protocol::template index_of_v<State> * num_methods +
+      Protocol::template method_index<FunctionPointer>;
+
+  template <auto State, auto FunctionPointer>
+  static constexpr std::size_t final_transition_edge =
+      num_states * num_methods +
+      Protocol::template index_of_v<State> * num_final_methods +
+      Protocol::template final_method_index<FunctionPointer>;
+
+  // Indexed by state.
+  std::array<std::atomic<std::uint64_t>, num_states> constructions{};
+  // Indexed by edge.
+  std::array<LatencyHistogram, num_edges> transitions;
+
+  static ProtocolMetrics& local() {
+    return ThreadBlocks<ProtocolMetrics>::local();
+  }
+
+  static void register_metrics() {
+    MetricsExporter::add({"protenc_objects_created", "counter",
+                          "Objects created, by initial state."},
+                         &write_constructions);
+    MetricsExporter::add({"protenc_transitions", "counter",
+                          "Transitions taken, by state and method."},
+                         &write_transition_counts);
+    MetricsExporter::add({"protenc_transition_duration_seconds", "histogram",
+                          "Duration of the transitions, by state and method."},
+                         &write_transition_durations);
+  }
+
+  // Call f(edge, labels) for the valid edges of the protocol, in order.
+  template <typename F>
+  static void for_each_edge(F&& f) {
+    for (std::size_t state = 0; state < num_states; ++state) {
+      for (std::size_t method = 0; method < num_methods; ++method) {
+        if (Protocol::next_state_index(state, method) == num_states) continue;
+        f(state * num_methods + method,
+          render_labels({{"protocol", Names::protocol_name},
+                         {"state", Names::state_name_at(state)},
+                         {"method", Names::method_name(method)}}));
+      }
+      for (std::size_t method = 0; method < num_final_methods; ++method) {
+        if (!Protocol::is_final_transition(state, method)) continue;
+        f(num_states * num_methods + state * num_final_methods + method,
+          render_labels({{"protocol", Names::protocol_name},
+                         {"state", Names::state_name_at(state)},
+                         {"method", Names::final_method_name(method)}}));
+      }
+    }
+  }
+
+  // The histograms of all the threads, by edge.
+  static std::vector<LatencyHistogram::Snapshot> snapshots() {
+    std::vector<LatencyHistogram::Snapshot> result(num_edges);
+    ThreadBlocks<ProtocolMetrics>::for_each(
+        [&](const ProtocolMetrics& metrics) {
+          for (std::size_t edge = 0; edge < num_edges; ++edge) {
+            metrics.transitions[edge].add_to(result[edge]);
+          }
+        });
+    return result;
+  }
+
+  static void write_constructions(std::string& out) {
+    std::array<std::uint64_t, num_states> counts{};
+    ThreadBlocks<ProtocolMetrics>::for_each(
+        [&](const ProtocolMetrics& metrics) {
+          for (std::size_t state = 0; state < num_states; ++state) {
+            counts[state] +=
+                metrics.constructions[state].load(std::memory_order_relaxed);
+          }
+        });
+    for (std::size_t state = 0; state < num_states; ++state) {
+      if (counts[state] == 0) continue;
+      append_sample(out, "protenc_objects_created_total",
+                    render_labels({{"protocol", Names::protocol_name},
+                                   {"state", Names::state_name_at(state)}}),
+                    counts[state]);
+    }
+  }
+
+  static void write_transition_counts(std::string& out) {
+    const std::vector<LatencyHistogram::Snapshot> all = snapshots();
+    for_each_edge([&](std::size_t edge, const std::string& labels) {
+      append_sample(out, "protenc_transitions_total", labels,
+                    all[edge].count());
+    });
+  }
+
+  static void write_transition_durations(std::string& out) {
+    const std::vector<LatencyHistogram::Snapshot> all = snapshots();
+    for_each_edge([&](std::size_t edge, const std::string& labels) {
+      LatencyHistogram::append(out, "protenc_transition_duration_seconds",
+                               all[edge], labels);
+    });
+  }
+};
+
+} // namespace internal
+
+// Policy counting the objects and transitions of the protocol, and timing the
+// transitions, to export them with WriteOpenMetrics, e.g.:
+//   PROTENC_START_WRAPPER_WITH_POLICY(RequestBuilderWrapper, RequestBuilder,
+//                                     ..., prot_enc::MetricsPolicy);
+struct MetricsPolicy : DefaultPolicy {
+  using Clock = std::chrono::steady_clock;
+
+  template <typename Protocol, auto State, typename Slot>
+  static void on_construct(Slot&) {
+    internal::add_relaxed(
+        internal::ProtocolMetrics<Protocol>::local()
+            .constructions[Protocol::template index_of_v<State>],
+        std::uint64_t{1});
+  }
+
+  template <typename Protocol, auto From, auto To, auto FunctionPointer,
+            typename Slot, typename Call>
+  static void on_transition(Slot&, Call&& call) {
+    using Metrics = internal::ProtocolMetrics<Protocol>;
+    constexpr std::size_t edge =
+        Metrics::template transition_edge<From, FunctionPointer>;
+    const Clock::time_point start = Clock::now();
+    call();
+    Metrics::local().transitions[edge].record(
+        internal::elapsed_ns<Clock>(start));
+  }
+
+  template <typename Protocol, auto From, auto FunctionPointer, typename Slot,
+            typename Call>
+  static decltype(auto) on_final_transition(Slot&,
+                                            typename Protocol::Wrapped&,
+                                            Call&& call) {
+    using Metrics = internal::ProtocolMetrics<Protocol>;
+    constexpr std::size_t edge =
+        Metrics::template final_transition_edge<From, FunctionPointer>;
+    const Clock::time_point start = Clock::now();
+    if constexpr (std::is_void_v<decltype(call())>) {
+      call();
+      Metrics::local().transitions[edge].record(
+          internal::elapsed_ns<Clock>(start));
+    } else {
+      decltype(auto) result = call();
+      Metrics::local().transitions[edge].record(
+          internal::elapsed_ns<Clock>(start));
+      return result;
+    }
+  }
+};
+
+} // namespace prot_enc
+
+#endif // PROTENC_METRICS_H_
@@ -0,0 +1,481 @@
+/**********************************
+ * MIT License (see LICENSE).     *
+ *                                *
+ * Copyright (c) 2019 nitnelave   *
+ *                                *
+ **********************************
+ *
+ *
+ * ProtEnc -- State and method names
+ *
+ * Names of the states and methods of a protocol, derived at compile time from
+ * the protocol description (the enum value names and the member function
+ * names), and a compile-time perfect hash mapping the names back to the states
+ * and method indices: one hash of the name and one comparison, no map.
+ **/
+
+#ifndef PROTENC_NAMES_H_
+#define PROTENC_NAMES_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "protenc.h"
+
+namespace prot_enc {
+
+/******************************************************************************
+ *  PERFECT HASH                                                              *
+ ******************************************************************************/
+
+namespace internal {
+
+constexpr std::size_t next_prime(std::size_t n) {
+  for (;; ++n) {
+    bool prime = n >= 2;
+    for (std::size_t d = 2; prime && d * d <= n; ++d) prime = n % d != 0;
+    if (prime) return n;
+  }
+}
+
+} // namespace internal
+
+// Compile-time perfect hash of N distinct names, mapping each name to its
+// position in the list, e.g.:
+//   constexpr StaticNameMap<3> map({"START", "HEADERS", "BODY"});
+//   static_assert(map.built());
+//   map.find("HEADERS") -> 1
+//   map.find("OTHER") -> 3 (not found)
+// The names are hashed once (8 characters at a time), the high bits of the hash
+// select a bucket, and the displacement of the bucket (found at compile time)
+// gives the slot with the other bits. The name in the slot is then compared to
+// the key.
+template <std::size_t N>
+class StaticNameMap {
+ public:
+  static constexpr std::size_t num_buckets = N / 2 + 1;
+  // Prime: see slot().
+  static constexpr std::size_t num_slots = internal::next_prime(N + N / 4 + 1);
+  // Seeds of the hash tried before giving up.
+  static constexpr std::uint64_t max_seeds = 64;
+
+  constexpr explicit StaticNameMap(const std::array<std::string_view, N>& names)
+      : names_(names) {
+    // Try seeds until every bucket finds a displacement; with the table
+    // slightly larger than N, the first seed almost always works.
+    for (seed_ = 0; seed_ < max_seeds; ++seed_) {
+      if (build()) {
+        built_ = true;
+        return;
+      }
+    }
+  }
+
+  // Whether the perfect hash was found: find() is meaningless otherwise. The
+  // names must be distinct. Check it where the map is defined:
+  //   static_assert(map.built(), "No perfect hash for the names");
+  constexpr bool built() const { return built_; }
+
+  // Position of the name in the list, or N if it is not in the list.
+  constexpr std::size_t find(std::string_view name) const {
+    const std::uint64_t hash = hash_name(name, seed_);
+    const std::size_t index =
+        slots_[slot(hash, displacements_[bucket(hash)])];
+    return index < N && names_[index] == name ? index : N;
+  }
+
+  constexpr std::string_view name(std::size_t index) const {
+    return names_[index];
+  }
+
+  constexpr std::size_t size() const { return N; }
+
+ private:
+  static constexpr std::uint64_t hash_name(std::string_view name,
+                                           std::uint64_t seed) {
+    std::uint64_t hash = 0xcbf29ce484222325ull ^
+                         (seed * 0x9e3779b97f4a7c15ull) ^ name.size();
+    // 8 characters at a time (the compiler turns the loop reading a word into
+    // a single load), then the last 0 to 7.
+    std::size_t i = 0;
+    for (; i + 8 <= name.size(); i += 8) {
+      hash = mix_word(hash, read_word(name, i, 8));
+    }
+    if (i < name.size()) {
+      hash = mix_word(hash, read_word(name, i, name.size() - i));
+    }
+    // Final mix, so that the high bits depend on all the characters.
+    hash ^= hash >> 29;
+    hash *= 0xbf58476d1ce4e5b9ull;
+    hash ^= hash >> 32;
+    return hash;
+  }
+
+  // Little-endian word of the `size` characters at `position`.
+  static constexpr std::uint64_t read_word(std::string_view name,
+                                           std::size_t position,
+                                           std::size_t size) {
+    std::uint64_t word = 0;
+    for (std::size_t j = 0; j < size; ++j) {
+      word |= static_cast<std::uint64_t>(
+                  static_cast<unsigned char>(name[position + j]))
+              << (8 * j);
+    }
+    return word;
+  }
+
+  static constexpr std::uint64_t mix_word(std::uint64_t hash,
+                                          std::uint64_t word) {
+    hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+    return hash ^ (hash >> 32);
+  }
+
+  static constexpr std::size_t bucket(std::uint64_t hash) {
+    return static_cast<std::size_t>((hash >> 32) % num_buckets);
+  }
+
+  // The slot is h1 + displacement * h2 (mod num_slots), with h2 never 0: as
+  // num_slots is prime, two names of a bucket get the same slot for at most
+  // one of the num_slots displacements, unless they have the same h1 and h2
+  // (and then the next seed separates them).
+  static constexpr std::size_t slot(std::uint64_t hash,
+                                    std::uint32_t displacement) {
+    const std::uint64_t h1 = (hash & 0xffffffffull) % num_slots;
+    const std::uint64_t h2 =
+        1 + ((hash * 0x9e3779b97f4a7c15ull) >> 32) % (num_slots - 1);
+    return static_cast<std::size_t>((h1 + displacement * h2) % num_slots);
+  }
+
+  // Find a displacement for every bucket, largest buckets first. Returns
+  // false if a bucket has no displacement putting its names in free slots.
+  constexpr bool build() {
+    std::array<std::uint64_t, N> hashes{};
+    // The names sorted by bucket: the names of the bucket b are
+    // by_bucket[bucket_start[b]..bucket_start[b + 1]].
+    std::array<std::size_t, num_buckets + 1> bucket_start{};
+    std::array<std::size_t, N> by_bucket{};
+    for (std::size_t i = 0; i < N; ++i) {
+      hashes[i] = hash_name(names_[i], seed_);
+      ++bucket_start[bucket(hashes[i]) + 1];
+    }
+    std::size_t max_bucket_size = 0;
+    for (std::size_t b = 0; b < num_buckets; ++b) {
+      const std::size_t size = bucket_start[b + 1];
+      max_bucket_size = size > max_bucket_size ? size : max_bucket_size;
+      bucket_start[b + 1] += bucket_start[b];
+    }
+    std::array<std::size_t, num_buckets> filled{};
+    for (std::size_t i = 0; i < N; ++i) {
+      const std::size_t b = bucket(hashes[i]);
+      by_bucket[bucket_start[b] + filled[b]++] = i;
+    }
+
+    for (std::size_t& index : slots_) index = N;
+    for (std::size_t size = max_bucket_size; size > 0; --size) {
+      for (std::size_t b = 0; b < num_buckets; ++b) {
+        if (bucket_start[b + 1] - bucket_start[b] != size) continue;
+        if (!place_bucket(b, hashes, by_bucket.data() + bucket_start[b],
+                          size)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  constexpr bool place_bucket(std::size_t b,
+                              const std::array<std::uint64_t, N>& hashes,
+                              const std::size_t* names, std::size_t size) {
+    // The slots repeat after num_slots displacements.
+    for (std::uint32_t displacement = 0; displacement < num_slots;
+         ++displacement) {
+      std::size_t placed = 0;
+      // Claim the slots right away, to detect collisions within the bucket.
+      while (placed < size &&
+             slots_[slot(hashes[names[placed]], displacement)] == N) {
+        slots_[slot(hashes[names[placed]], displacement)] = names[placed];
+        ++placed;
+      }
+      if (placed == size) {
+        displacements_[b] = displacement;
+        return true;
+      }
+      // Release the slots claimed with this displacement.
+      for (std::size_t i = 0; i < placed; ++i) {
+        slots_[slot(hashes[names[i]], displacement)] = N;
+      }
+    }
+    return false;
+  }
+
+  std::array<std::string_view, N> names_;
+  std::uint64_t seed_ = 0;
+  bool built_ = false;
+  std::array<std::uint32_t, num_buckets> displacements_{};
+  // Position in names_ of the name in each slot, or N.
+  std::array<std::size_t, num_slots> slots_{};
+};
+
+
+/******************************************************************************
+ *  NAMES OF VALUES                                                           *
+ ******************************************************************************/
+
+namespace internal {
+
+// The compiler's description of the function, containing the value.
+template <auto ProtEncValue>
+constexpr std::string_view raw_value_name() {
+#if defined(__GNUC__) || defined(__clang__)
+  return __PRETTY_FUNCTION__;
+#else
+  return __FUNCSIG__;
+#endif
+}
+
+// Name of the value in the description: for GCC and Clang, it is after
+// "ProtEncValue = ", and for MSVC it is the template argument. Only the last
+// component is kept: "&MyClass::my_function" -> "my_function",
+// "MyEnum::VALUE" -> "VALUE".
+constexpr std::string_view extract_value_name(std::string_view raw) {
+  constexpr std::string_view gcc_marker = "ProtEncValue = ";
+  constexpr std::string_view msvc_marker = "raw_value_name<";
+  std::size_t begin = raw.find(gcc_marker);
+  std::size_t end;
+  if (begin != std::string_view::npos) {
+    begin += gcc_marker.size();
+    end = raw.find_first_of(";]", begin);
+  } else {
+    begin = raw.find(msvc_marker) + msvc_marker.size();
+    end = raw.rfind(">(");
+  }
+  std::string_view name = raw.substr(begin, end - begin);
+  const std::size_t scope = name.rfind("::");
+  if (scope != std::string_view::npos) name.remove_prefix(scope + 2);
+  return name;
+}
+
+// Copy of the name of the value, in static storage.
+template <auto Value>
+struct value_name_t {
+  static constexpr std::string_view raw =
+      extract_value_name(raw_value_name<Value>());
+  static constexpr auto storage = [] {
+    std::array<char, raw.size() + 1> result{};
+    for (std::size_t i = 0; i < raw.size(); ++i) result[i] = raw[i];
+    return result;
+  }();
+  static constexpr std::string_view value{storage.data(), raw.size()};
+};
+
+// The compiler's description of the function, containing the type.
+template <typename ProtEncType>
+constexpr std::string_view raw_type_name() {
+#if defined(__GNUC__) || defined(__clang__)
+  return __PRETTY_FUNCTION__;
+#else
+  return __FUNCSIG__;
+#endif
+}
+
+// Name of the type in the description, as written by the compiler (with its
+// namespaces).
+constexpr std::string_view extract_type_name(std::string_view raw) {
+  constexpr std::string_view gcc_marker = "ProtEncType = ";
+  constexpr std::string_view msvc_marker = "raw_type_name<";
+  std::size_t begin = raw.find(gcc_marker);
+  std::size_t end;
+  if (begin != std::string_view::npos) {
+    begin += gcc_marker.size();
+    end = raw.find_first_of(";]", begin);
+  } else {
+    begin = raw.find(msvc_marker) + msvc_marker.size();
+    end = raw.rfind(">(");
+  }
+  std::string_view name = raw.substr(begin, end - begin);
+  for (std::string_view keyword : {"class ", "struct ", "enum "}) {
+    if (name.substr(0, keyword.size()) == keyword) {
+      name.remove_prefix(keyword.size());
+    }
+  }
+  return name;
+}
+
+template <typename T>
+struct type_name_t {
+  static constexpr std::string_view raw =
+      extract_type_name(raw_type_name<T>());
+  static constexpr auto storage = [] {
+    std::array<char, raw.size() + 1> result{};
+    for (std::size_t i = 0; i < raw.size(); ++i) result[i] = raw[i];
+    return result;
+  }();
+  static constexpr std::string_view value{storage.data(), raw.size()};
+};
+
+} // namespace internal
+
+// Name of a type, e.g. type_name<HTTPConnectionBuilder> ->
+// "HTTPConnectionBuilder".
+template <typename T>
+constexpr std::string_view type_name = internal::type_name_t<T>::value;
+
+// Name of an enum value or a member function, without the scope, e.g.:
+//   value_name<HTTPBuilderState::START> -> "START"
+//   value_name<&HTTPConnectionBuilder::add_header> -> "add_header"
+template <auto Value>
+constexpr std::string_view value_name = internal::value_name_t<Value>::value;
+
+
+/******************************************************************************
+ *  NAMES OF A PROTOCOL                                                       *
+ ******************************************************************************/
+
+// Names of the states and methods of the protocol of AnyWrapper (the wrapper in
+// any state of the protocol), and the mapping back from the names:
+//   using Names =
+//       ProtocolNames<HTTPConnectionBuilderWrapper<HTTPBuilderState::START>>;
+//   Names::state_name(HTTPBuilderState::BODY) -> "BODY"
+//   Names::find_state("HEADERS") -> HTTPBuilderState::HEADERS
+//   Names::find_method("add_body") -> Protocol::method_index<&...::add_body>
+template <typename AnyWrapper>
+class ProtocolNames {
+ public:
+  using Protocol = typename AnyWrapper::Protocol;
+  using State = typename Protocol::State;
+  static constexpr std::size_t num_states = Protocol::num_states;
+  static constexpr std::size_t num_methods = Protocol::num_methods;
+
+  // Name of the state with the given index in Protocol::states.
+  static constexpr std::string_view state_name_at(std::size_t state_index) {
+    return state_map.name(state_index);
+  }
+
+  // Empty if the value is not one of the states of the protocol.
+  static constexpr std::string_view state_name(State state) {
+    const std::size_t index = state_index(state);
+    if (index == num_states) return {};
+    return state_map.name(index);
+  }
+
+  static constexpr std::optional<State> find_state(std::string_view name) {
+    const std::size_t index = state_map.find(name);
+    if (index == num_states) return std::nullopt;
+    return Protocol::states[index];
+  }
+
+  // Index in Protocol::states of the state with that name, or num_states.
+  static constexpr std::size_t find_state_index(std::string_view name) {
+    return state_map.find(name);
+  }
+
+  static constexpr std::string_view method_name(std::size_t method_index) {
+    return method_map.name(method_index);
+  }
+
+  // Index of the method with that name, or num_methods.
+  static constexpr std::size_t find_method(std::string_view name) {
+    return method_map.find(name);
+  }
+
+  static constexpr std::size_t num_final_methods = Protocol::num_final_methods;
+
+  static constexpr std::string_view final_method_name(
+      std::size_t final_method_index) {
+    return final_method_names[final_method_index];
+  }
+
+  // Name of the protocol: the name of the class of its functions.
+  static constexpr std::string_view protocol_name =
+      type_name<typename Protocol::Object>;
+
+ private:
+  template <std::size_t... I>
+  static constexpr std::array<std::string_view, num_states> make_state_names(
+      std::index_sequence<I...>) {
+    return {value_name<Protocol::states[I]>...};
+  }
+
+  template <std::size_t... M>
+  static constexpr std::array<std::string_view, num_methods>
+  make_method_names(std::index_sequence<M...>) {
+    return {value_name<Protocol::template method<M>>...};
+  }
+
+  static constexpr StaticNameMap<num_states> state_map{
+      make_state_names(std::make_index_sequence<num_states>())};
+  template <std::size_t... M>
+  static constexpr std::array<std::string_view, num_final_methods>
+  make_final_method_names(std::index_sequence<M...>) {
+    return {value_name<Protocol::template final_method<M>>...};
+  }
+
+  static constexpr StaticNameMap<num_methods> method_map{
+      make_method_names(std::make_index_sequence<num_methods>())};
+  static_assert(state_map.built() && method_map.built(),
+                "No perfect hash found for the names of the states or "
+                "methods: are they distinct?");
+  // The final methods are only named, not looked up.
+  static constexpr std::array<std::string_view, num_final_methods>
+      final_method_names = make_final_method_names(
+          std::make_index_sequence<num_final_methods>());
+
+  // For enums with a small range of values, the index of each state is in a
+  // table indexed by value; otherwise it is looked up in Protocol::states.
+  struct ValueRange {
+    long long min = 0;
+    long long max = -1;
+  };
+
+  static constexpr ValueRange value_range = [] {
+    ValueRange range;
+    if constexpr (std::is_enum_v<State> || std::is_integral_v<State>) {
+      for (std::size_t i = 0; i < num_states; ++i) {
+        const auto value = static_cast<long long>(Protocol::states[i]);
+        if (i == 0 || value < range.min) range.min = value;
+        if (i == 0 || value > range.max) range.max = value;
+      }
+    }
+    return range;
+  }();
+
+  static constexpr std::size_t value_range_size =
+      static_cast<std::size_t>(value_range.max - value_range.min + 1);
+  static constexpr bool use_value_table =
+      (std::is_enum_v<State> || std::is_integral_v<State>) &&
+      value_range_size <= 4 * num_states + 16;
+
+  static constexpr auto value_table = [] {
+    std::array<std::size_t, use_value_table ? value_range_size : 0> table{};
+    if constexpr (use_value_table) {
+      for (std::size_t& index : table) index = num_states;
+      for (std::size_t i = 0; i < num_states; ++i) {
+        table[static_cast<long long>(Protocol::states[i]) - value_range.min] =
+            i;
+      }
+    }
+    return table;
+  }();
+
+  // Index in Protocol::states, or num_states.
+  static constexpr std::size_t state_index(State state) {
+    if constexpr (use_value_table) {
+      const long long value = static_cast<long long>(state);
+      if (value < value_range.min || value > value_range.max) {
+        return num_states;
+      }
+      return value_table[value - value_range.min];
+    } else {
+      return Protocol::index_of(state);
+    }
+  }
+};
+
+} // namespace prot_enc
+
+#endif // PROTENC_NAMES_H_
@@ -0,0 +1,93 @@
+/**********************************
+ * MIT License (see LICENSE).     *
+ *                                *
+ * Copyright (c) 2019 nitnelave   *
+ *                                *
+ **********************************
+ *
+ *
+ * ProtEnc -- Recycling the wrapped objects
+ *
+ * A final transition consumes the wrapped object, but the object itself
+ * (moved-from) is then destroyed along with the buffers it still holds, and the
+ * next wrapper starts again from Wrapped{}. With the RecyclingPolicy, the
+ * object is reset and kept in a per-thread free list after the final
+ * transition, and the next default-constructed wrapper takes it from there,
+ * with its warmed-up buffers.
+ **/
+
+#ifndef PROTENC_RECYCLING_H_
+#define PROTENC_RECYCLING_H_
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "protenc.h"
+
+namespace prot_enc {
+
+// Policy recycling the wrapped objects after the final transitions, keeping up
+// to MaxFreeObjects of them per thread. The wrapped class must have a
+// `void reset()` method, putting the object back in its initial state while
+// keeping its capacity (e.g. clear() the containers). e.g.:
+//   PROTENC_START_WRAPPER_WITH_POLICY(RequestBuilderWrapper, RequestBuilder,
+//                                     ..., prot_enc::RecyclingPolicy<>);
+template <std::size_t MaxFreeObjects = 64>
+struct RecyclingPolicy : DefaultPolicy {
+  template <typename Protocol, typename MakeNew>
+  static typename Protocol::Wrapped make_wrapped(MakeNew&& make_new) {
+    auto& objects = free_objects<typename Protocol::Wrapped>();
+    if (objects.empty()) return make_new();
+    typename Protocol::Wrapped wrapped = std::move(objects.back());
+    objects.pop_back();
+    return wrapped;
+  }
+
+  template <typename Protocol, auto From, auto FunctionPointer, typename Slot,
+            typename Call>
+  static decltype(auto) on_final_transition(
+      Slot&, typename Protocol::Wrapped& wrapped, Call&& call) {
+    static_assert(
+        requires { wrapped.reset(); },
+        "The wrapped class needs a reset() method to be recycled");
+    if constexpr (std::is_void_v<decltype(call())>) {
+      call();
+      recycle(wrapped);
+    } else {
+      decltype(auto) result = call();
+      recycle(wrapped);
+      return result;
+    }
+  }
+
+  // Number of objects waiting to be reused in this thread.
+  template <typename Wrapped>
+  static std::size_t num_free_objects() {
+    return free_objects<Wrapped>().size();
+  }
+
+ private:
+  template <typename Wrapped>
+  static std::vector<Wrapped>& free_objects() {
+    thread_local std::vector<Wrapped> objects = [] {
+      std::vector<Wrapped> result;
+      result.reserve(MaxFreeObjects);
+      return result;
+    }();
+    return objects;
+  }
+
+  template <typename Wrapped>
+  static void recycle(Wrapped& wrapped) {
+    auto& objects = free_objects<Wrapped>();
+    if (objects.size() >= MaxFreeObjects) return;
+    wrapped.reset();
+    objects.push_back(std::move(wrapped));
+  }
+};
+
+} // namespace prot_enc
+
+#endif // PROTENC_RECYCLING_H_
@@ -0,0 +1,146 @@
+/**********************************
+ * MIT License (see LICENSE).     *
+ *                                *
+ * Copyright (c) 2019 nitnelave   *
+ *                                *
+ **********************************
+ *
+ *
+ * ProtEnc -- Sampled protocol metrics
+ *
+ * The MetricsPolicy times every transition: two clock reads, and the lookup of
+ * the per-thread counters. On the protocols with the highest rates, the
+ * SampledMetricsPolicy only measures one event in N (on average), chosen by a
+ * per-thread countdown: the other events only decrement it. Each sampled event
+ * is recorded with a weight of the number of events since the previous sample,
+ * so that the exported counts and histograms (the same as the MetricsPolicy's)
+ * estimate the totals.
+ **/
+
+#ifndef PROTENC_SAMPLING_H_
+#define PROTENC_SAMPLING_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+
+#include "protenc.h"
+#include "protenc_metrics.h"
+
+namespace prot_enc {
+
+namespace internal {
+
+inline std::atomic<std::uint32_t> sampling_period{64};
+
+struct SamplingCountdown {
+  // Events until the next sample, this one included.
+  std::uint64_t remaining = 1;
+  // Events since the previous sample, i.e. the weight of the next one.
+  std::uint64_t weight = 1;
+  // State of the xorshift generator of the gaps between the samples.
+  std::uint64_t random = 0;
+};
+
+// Constant-initialized: no guard on access.
+inline thread_local SamplingCountdown sampling_countdown;
+
+[[gnu::noinline]] inline std::uint64_t next_sample(
+    SamplingCountdown& countdown) {
+  const std::uint64_t weight = countdown.weight;
+  if (countdown.random == 0) {
+    countdown.random = reinterpret_cast<std::uintptr_t>(&countdown) | 1;
+  }
+  countdown.random ^= countdown.random << 13;
+  countdown.random ^= countdown.random >> 7;
+  countdown.random ^= countdown.random << 17;
+  // A gap uniform in [1, 2 * period - 1], of mean period: a fixed gap would
+  // always sample the same transitions of objects with a fixed number of them.
+  const std::uint64_t period =
+      sampling_period.load(std::memory_order_relaxed);
+  countdown.remaining = 1 + countdown.random % (2 * period - 1);
+  countdown.weight = countdown.remaining;
+  return weight;
+}
+
+// 0 if the current event is not sampled, or the number of events it stands
+// for.
+inline std::uint64_t sample() {
+  SamplingCountdown& countdown = sampling_countdown;
+  if (--countdown.remaining != 0) [[likely]] {
+    return 0;
+  }
+  return next_sample(countdown);
+}
+
+} // namespace internal
+
+// Measure one event in `period` (at least 1), on average. Each thread takes it
+// into account after its next sample.
+inline void SetSamplingPeriod(std::uint32_t period) {
+  internal::sampling_period.store(period == 0 ? 1 : period,
+                                  std::memory_order_relaxed);
+}
+
+// Policy counting and timing a sample of the constructions and transitions of
+// the protocol, to export with WriteOpenMetrics, e.g.:
+//   PROTENC_START_WRAPPER_WITH_POLICY(PacketWrapper, Packet, ...,
+//                                     prot_enc::SampledMetricsPolicy);
+//   ...
+//   prot_enc::SetSamplingPeriod(1000);
+// The counts are estimates, exact only with a period of 1.
+struct SampledMetricsPolicy : DefaultPolicy {
+  using Clock = std::chrono::steady_clock;
+
+  template <typename Protocol, auto State, typename Slot>
+  static void on_construct(Slot&) {
+    const std::uint64_t weight = internal::sample();
+    if (weight == 0) return;
+    internal::add_relaxed(
+        internal::ProtocolMetrics<Protocol>::local()
+            .constructions[Protocol::template index_of_v<State>],
+        weight);
+  }
+
+  template <typename Protocol, auto From, auto To, auto FunctionPointer,
+            typename Slot, typename Call>
+  static void on_transition(Slot&, Call&& call) {
+    using Metrics = internal::ProtocolMetrics<Protocol>;
+    const std::uint64_t weight = internal::sample();
+    if (weight == 0) return call();
+    constexpr std::size_t edge =
+        Metrics::template transition_edge<From, FunctionPointer>;
+    const Clock::time_point start = Clock::now();
+    call();
+    Metrics::local().transitions[edge].record(
+        internal::elapsed_ns<Clock>(start), weight);
+  }
+
+  template <typename Protocol, auto From, auto FunctionPointer, typename Slot,
+            typename Call>
+  static decltype(auto) on_final_transition(Slot&,
+                                            typename Protocol::Wrapped&,
+                                            Call&& call) {
+    using Metrics = internal::ProtocolMetrics<Protocol>;
+    const std::uint64_t weight = internal::sample();
+    if (weight == 0) return call();
+    constexpr std::size_t edge =
+        Metrics::template final_transition_edge<From, FunctionPointer>;
+    const Clock::time_point start = Clock::now();
+    if constexpr (std::is_void_v<decltype(call())>) {
+      call();
+      Metrics::local().transitions[edge].record(
+          internal::elapsed_ns<Clock>(start), weight);
+    } else {
+      decltype(auto) result = call();
+      Metrics::local().transitions[edge].record(
+          internal::elapsed_ns<Clock>(start), weight);
+      return result;
+    }
+  }
+};
+
+} // namespace prot_enc
+
+#endif // PROTENC_SAMPLING_H_
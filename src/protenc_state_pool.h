@@ -0,0 +1,344 @@
+/**********************************
+ * MIT License (see LICENSE).     *
+ *                                *
+ * Copyright (c) 2019 nitnelave   *
+ *                                *
+ **********************************
+ *
+ *
+ * ProtEnc -- State-partitioned object pool
+ *
+ * A container for many objects of the same protocol, in different states. The
+ * objects are stored in one contiguous bucket per state of the protocol, and
+ * move from one bucket to the other when they take a transition. That way, all
+ * the objects in a given state can be processed in a tight loop over an array.
+ **/
+
+#ifndef PROTENC_STATE_POOL_H_
+#define PROTENC_STATE_POOL_H_
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "protenc.h"
+
+namespace prot_enc {
+
+// Stable reference to an object in a StatePool. It stays valid while the
+// object moves between buckets, until the object leaves the pool. The index is
+// then reused by the next object, with a new generation: StatePool::contains
+// tells the stale handles apart.
+struct PoolHandle {
+  std::uint32_t index;
+  std::uint32_t generation;
+
+  friend bool operator==(PoolHandle lhs, PoolHandle rhs) {
+    return lhs.index == rhs.index && lhs.generation == rhs.generation;
+  }
+  friend bool operator!=(PoolHandle lhs, PoolHandle rhs) {
+    return !(lhs == rhs);
+  }
+};
+
+// Pool of objects following the protocol of AnyWrapper, which can be the
+// wrapper in any state of the protocol, e.g.:
+//   StatePool<HTTPConnectionBuilderWrapper<HTTPBuilderState::START>> pool;
+//   PoolHandle handle = pool.insert(GetConnectionBuilder().add_header("h"));
+//   pool.for_each<HTTPBuilderState::HEADERS>([](auto builder) {
+//     return std::move(builder).add_body("body");
+//   });
+// The objects keep the Slot of the policy of their wrapper while they are in
+// the pool, and the hooks of the policy are called for their transitions.
+template <typename AnyWrapper>
+class StatePool {
+ public:
+  using Protocol = typename AnyWrapper::Protocol;
+  using State = typename Protocol::State;
+  using Wrapped = typename Protocol::Wrapped;
+  template <State S>
+  using Wrapper = typename Protocol::template Wrapper<S>;
+
+  static constexpr std::size_t num_states = Protocol::num_states;
+
+  StatePool() = default;
+  StatePool(StatePool&&) = default;
+  StatePool& operator=(StatePool&& other) {
+    destroy_all();
+    buckets_ = std::move(other.buckets_);
+    locations_ = std::move(other.locations_);
+    generations_ = std::move(other.generations_);
+    free_handles_ = std::move(other.free_handles_);
+    return *this;
+  }
+
+  // The objects left in the pool are destroyed.
+  ~StatePool() { destroy_all(); }
+
+  // Take ownership of the object held by the wrapper, and file it in the
+  // bucket of its state.
+  template <typename W>
+  PoolHandle insert(W&& wrapper) {
+    static_assert(std::is_same_v<typename W::Protocol, Protocol>,
+                  "The wrapper does not follow the protocol of the pool");
+    constexpr std::size_t state_index = Protocol::index_of(W::state);
+    std::uint32_t index;
+    if (free_handles_.empty()) {
+      index = static_cast<std::uint32_t>(locations_.size());
+      locations_.emplace_back();
+      generations_.push_back(0);
+    } else {
+      index = free_handles_.back();
+      free_handles_.pop_back();
+    }
+    push(state_index, index, internal::WrapperAccess::take(wrapper));
+    return PoolHandle{index, generations_[index]};
+  }
+
+  // Whether the object of the handle is still in the pool.
+  bool contains(PoolHandle handle) const {
+    return handle.index < generations_.size() &&
+           generations_[handle.index] == handle.generation &&
+           locations_[handle.index].state != kFree;
+  }
+
+  // Take the object out of the pool. It must be in the state S.
+  template <State S>
+  Wrapper<S> extract(PoolHandle handle) {
+    constexpr std::size_t state_index = Protocol::template index_of_v<S>;
+    assert(contains(handle) && "Stale handle");
+    const Location location = locations_[handle.index];
+    assert(location.state == state_index && "Object not in this state");
+    Stored object =
+        std::move(buckets_[state_index].objects[location.position]);
+    remove(state_index, location.position);
+    free_handle(handle.index);
+    return internal::WrapperAccess::make<Wrapper<S>>(std::move(object));
+  }
+
+  // Destroy the object, whatever its state.
+  void erase(PoolHandle handle) {
+    assert(contains(handle) && "Stale handle");
+    const Location location = locations_[handle.index];
+    internal::WrapperAccess::destroy(
+        location.state, buckets_[location.state].objects[location.position]);
+    remove(location.state, location.position);
+    free_handle(handle.index);
+  }
+
+  // Current state of the object.
+  State state_of(PoolHandle handle) const {
+    assert(contains(handle) && "Stale handle");
+    return Protocol::states[locations_[handle.index].state];
+  }
+
+  // Take the transition FunctionPointer on the object, which must be in the
+  // state S. The object keeps its handle, and moves to the bucket of its new
+  // state.
+  template <State S, auto FunctionPointer, typename... Args>
+  void transition(PoolHandle handle, Args&&... args) {
+    constexpr std::size_t state_index = Protocol::template index_of_v<S>;
+    assert(contains(handle) && "Stale handle");
+    const Location location = locations_[handle.index];
+    assert(location.state == state_index && "Object not in this state");
+    Stored& object = buckets_[state_index].objects[location.position];
+    auto result =
+        internal::WrapperAccess::make<Wrapper<S>>(std::move(object))
+            .template call_transition<FunctionPointer>(
+                std::forward<Args>(args)...);
+    constexpr std::size_t new_state_index =
+        Protocol::index_of(decltype(result)::state);
+    if constexpr (new_state_index == state_index) {
+      object = internal::WrapperAccess::take(result);
+    } else {
+      remove(state_index, location.position);
+      push(new_state_index, handle.index,
+           internal::WrapperAccess::take(result));
+    }
+  }
+
+  // Index of the current state of the object in Protocol::states.
+  std::size_t state_index_of(PoolHandle handle) const {
+    assert(contains(handle) && "Stale handle");
+    return locations_[handle.index].state;
+  }
+
+  // Number of objects in the state S.
+  template <State S>
+  std::size_t size() const {
+    return buckets_[Protocol::template index_of_v<S>].objects.size();
+  }
+
+  // Number of objects in the pool.
+  std::size_t size() const {
+    return locations_.size() - free_handles_.size();
+  }
+
+  // Upper bound (exclusive) of the index of the handles given so far.
+  std::size_t handle_limit() const { return locations_.size(); }
+
+  // Reserve room for `count` objects in the state S.
+  template <State S>
+  void reserve(std::size_t count) {
+    Bucket& bucket = buckets_[Protocol::template index_of_v<S>];
+    bucket.objects.reserve(count);
+    bucket.owners.reserve(count);
+  }
+
+  // Call `function` with every object in the state S, as a Wrapper<S> (and the
+  // handle of the object first, if `function` accepts it). If the function
+  // returns a wrapper, the object is stored back in the bucket of its new
+  // state; otherwise (e.g. it took a final transition) it leaves the pool.
+  template <State S, typename Function>
+  void for_each(Function&& function) {
+    constexpr std::size_t state_index = Protocol::template index_of_v<S>;
+    Bucket& bucket = buckets_[state_index];
+    using Result = decltype(invoke(function, PoolHandle{},
+                                   std::declval<Wrapper<S>>()));
+    std::size_t position = 0;
+    while (position < bucket.objects.size()) {
+      const std::uint32_t index = bucket.owners[position];
+      const PoolHandle handle{index, generations_[index]};
+      auto wrapper = [&] {
+        return internal::WrapperAccess::make<Wrapper<S>>(
+            std::move(bucket.objects[position]));
+      };
+      if constexpr (internal::is_wrapper_of<Result, Protocol>()) {
+        Result result = invoke(function, handle, wrapper());
+        if constexpr (Protocol::index_of(Result::state) == state_index) {
+          bucket.objects[position] = internal::WrapperAccess::take(result);
+          ++position;
+          continue;
+        } else {
+          push(Protocol::index_of(Result::state), index,
+               internal::WrapperAccess::take(result));
+        }
+      } else {
+        invoke(function, handle, wrapper());
+        free_handle(index);
+      }
+      // The object left the bucket: the last one takes its place, and is
+      // visited next.
+      remove(state_index, position);
+    }
+  }
+
+  // Take the transition FunctionPointer on every object in the state S, in a
+  // single loop over the bucket. The arguments are passed to every call.
+  template <State S, auto FunctionPointer, typename... Args>
+  void transition_all(const Args&... args) {
+    constexpr std::size_t state_index = Protocol::template index_of_v<S>;
+    constexpr std::size_t new_state_index = Protocol::index_of(
+        internal::return_of_transition<typename Protocol::Transitions, S,
+                                       FunctionPointer>);
+    constexpr State new_state = Protocol::states[new_state_index];
+    Bucket& bucket = buckets_[state_index];
+    for (Stored& object : bucket.objects) {
+      Protocol::Policy::template on_transition<Protocol, S, new_state,
+                                               FunctionPointer>(
+          object.slot, [&] {
+            internal::call_transition_function<typename Protocol::Transitions,
+                                               S, FunctionPointer>(
+                internal::object_of(object.wrapped), args...);
+          });
+    }
+    if constexpr (new_state_index != state_index) {
+      for (std::size_t i = 0; i < bucket.objects.size(); ++i) {
+        push(new_state_index, bucket.owners[i], std::move(bucket.objects[i]));
+      }
+      bucket.objects.clear();
+      bucket.owners.clear();
+    }
+  }
+
+ private:
+  using Stored = internal::StoredObject<Protocol>;
+
+  // State of the Location of a handle whose object left the pool.
+  static constexpr std::uint32_t kFree = ~std::uint32_t{0};
+
+  struct Location {
+    // Index of the state in Protocol::states, or kFree.
+    std::uint32_t state;
+    // Position in the bucket.
+    std::uint32_t position;
+  };
+
+  struct Bucket {
+    std::vector<Stored> objects;
+    // Handle index of each object.
+    std::vector<std::uint32_t> owners;
+  };
+
+  template <typename Function, typename W>
+  static decltype(auto) invoke(Function& function, PoolHandle handle,
+                               W&& wrapper) {
+    if constexpr (std::is_invocable_v<Function&, PoolHandle, W&&>) {
+      return function(handle, std::forward<W>(wrapper));
+    } else {
+      return function(std::forward<W>(wrapper));
+    }
+  }
+
+  void push(std::size_t state_index, std::uint32_t index, Stored&& object) {
+    Bucket& bucket = buckets_[state_index];
+    locations_[index] =
+        Location{static_cast<std::uint32_t>(state_index),
+                 static_cast<std::uint32_t>(bucket.objects.size())};
+    bucket.objects.push_back(std::move(object));
+    bucket.owners.push_back(index);
+  }
+
+  // The object of the handle left the pool: its handle becomes stale.
+  void free_handle(std::uint32_t index) {
+    locations_[index].state = kFree;
+    ++generations_[index];
+    free_handles_.push_back(index);
+  }
+
+  void destroy_all() {
+    for (std::size_t state = 0; state < num_states; ++state) {
+      for (Stored& object : buckets_[state].objects) {
+        internal::WrapperAccess::destroy(state, object);
+      }
+      buckets_[state].objects.clear();
+      buckets_[state].owners.clear();
+    }
+  }
+
+  // Move the object at position `from` to position `to` in the bucket.
+  void move_within(Bucket& bucket, std::size_t state_index, std::size_t from,
+                   std::size_t to) {
+    if (from == to) return;
+    bucket.objects[to] = std::move(bucket.objects[from]);
+    bucket.owners[to] = bucket.owners[from];
+    locations_[bucket.owners[to]] =
+        Location{static_cast<std::uint32_t>(state_index),
+                 static_cast<std::uint32_t>(to)};
+  }
+
+  // Remove the object at `position` by moving the last object in its place.
+  void remove(std::size_t state_index, std::size_t position) {
+    Bucket& bucket = buckets_[state_index];
+    move_within(bucket, state_index, bucket.objects.size() - 1, position);
+    bucket.objects.pop_back();
+    bucket.owners.pop_back();
+  }
+
+  std::array<Bucket, num_states> buckets_;
+  // Location of the object of each handle.
+  std::vector<Location> locations_;
+  // Generation of the handle of each index, incremented when its object
+  // leaves the pool.
+  std::vector<std::uint32_t> generations_;
+  // Handles of the objects that left the pool, to be reused.
+  std::vector<std::uint32_t> free_handles_;
+};
+
+} // namespace prot_enc
+
+#endif // PROTENC_STATE_POOL_H_
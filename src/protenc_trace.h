@@ -0,0 +1,315 @@
+/**********************************
+ * MIT License (see LICENSE).     *
+ *                                *
+ * Copyright (c) 2019 nitnelave   *
+ *                                *
+ **********************************
+ *
+ *
+ * ProtEnc -- Tracing the objects of a protocol
+ *
+ * The TracePolicy follows each object of the protocol as a span, from its
+ * construction in an initial state to its final transition, with an instant
+ * event at each transition, in the Chrome trace-event format (which Perfetto
+ * and chrome://tracing open). The spans are async events, keyed by an id
+ * carried in the Slot of the object, so that an object can move between
+ * threads. The events are recorded in per-thread buffers, without locks, and
+ * written to a file by WriteChromeTrace.
+ **/
+
+#ifndef PROTENC_TRACE_H_
+#define PROTENC_TRACE_H_
+
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "protenc.h"
+#include "protenc_metrics.h"
+#include "protenc_names.h"
+
+namespace prot_enc {
+
+namespace internal {
+
+struct TraceEvent {
+  std::uint64_t ts_ns;
+  std::uint64_t id;
+  // 'b' (begin), 'n' (instant) or 'e' (end) of an async span.
+  char phase;
+  // The names are static strings: only the views are stored.
+  std::string_view category;
+  std::string_view name;
+  std::string_view arg_name;
+  std::string_view arg_value;
+};
+
+// The events of one thread, in chunks that never move. Only the thread
+// writes: it fills the event, then publishes the new size with a release
+// store, and the export reads up to the published size. The export then
+// advances the consumed cursor, and the thread frees the chunks before it when
+// it needs a new one.
+class TraceBuffer {
+ public:
+  static constexpr std::size_t kChunkSize = 1024;
+  // The events not exported yet after that are dropped, and counted. At about
+  // 90 bytes per event, a thread holds up to about 90 MB of events between two
+  // exports.
+  static constexpr std::size_t kMaxEvents = std::size_t{1} << 20;
+
+  TraceBuffer() : first_(new Chunk), last_(first_), read_chunk_(first_) {
+    static std::atomic<std::uint32_t> num_buffers{0};
+    tid_ = num_buffers.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  TraceBuffer(const TraceBuffer&) = delete;
+  TraceBuffer& operator=(const TraceBuffer&) = delete;
+
+  ~TraceBuffer() {
+    for (Chunk* chunk = first_; chunk != nullptr;) {
+      Chunk* next = chunk->next.load(std::memory_order_relaxed);
+      delete chunk;
+      chunk = next;
+    }
+  }
+
+  void add(const TraceEvent& event) {
+    if (size_ - consumed_.load(std::memory_order_relaxed) == kMaxEvents)
+        [[unlikely]] {
+      add_relaxed(num_dropped_, std::uint64_t{1});
+      return;
+    }
+    const std::size_t index = size_ % kChunkSize;
+    if (index == 0 && size_ != 0) [[unlikely]] {
+      free_consumed_chunks();
+      Chunk* chunk = new Chunk;
+      last_->next.store(chunk, std::memory_order_release);
+      last_ = chunk;
+    }
+    last_->events[index] = event;
+    published_.store(++size_, std::memory_order_release);
+  }
+
+  // Ids unique across the threads: the buffer, then a counter.
+  std::uint64_t next_id() {
+    return (std::uint64_t{tid_} + 1) << 40 | ++num_ids_;
+  }
+
+  std::uint32_t tid() const { return tid_; }
+
+  std::uint64_t num_dropped() const {
+    return num_dropped_.load(std::memory_order_relaxed);
+  }
+
+  // Call f with each event published since the last call, and mark them as
+  // consumed. Only one export at a time (under the lock of ThreadBlocks).
+  template <typename F>
+  void consume(F&& f) const {
+    const std::size_t size = published_.load(std::memory_order_acquire);
+    Chunk* chunk = read_chunk_.load(std::memory_order_relaxed);
+    for (std::size_t i = consumed_.load(std::memory_order_relaxed); i < size;
+         ++i) {
+      if (i % kChunkSize == 0 && i != 0) {
+        chunk = chunk->next.load(std::memory_order_acquire);
+      }
+      f(chunk->events[i % kChunkSize]);
+    }
+    // The events before are not read anymore: the thread can free their
+    // chunks.
+    read_chunk_.store(chunk, std::memory_order_release);
+    consumed_.store(size, std::memory_order_release);
+  }
+
+ private:
+  struct Chunk {
+    std::array<TraceEvent, kChunkSize> events;
+    std::atomic<Chunk*> next{nullptr};
+  };
+
+  void free_consumed_chunks() {
+    const Chunk* read_chunk = read_chunk_.load(std::memory_order_acquire);
+    while (first_ != read_chunk) {
+      Chunk* next = first_->next.load(std::memory_order_relaxed);
+      delete first_;
+      first_ = next;
+    }
+  }
+
+  Chunk* first_;
+  // Written by the thread only.
+  Chunk* last_;
+  std::size_t size_ = 0;
+  std::uint64_t num_ids_ = 0;
+  std::atomic<std::size_t> published_{0};
+  std::atomic<std::uint64_t> num_dropped_{0};
+  std::uint32_t tid_;
+  // Written by the export only: the number of events consumed, and the chunk
+  // of the last one (the first chunk if none).
+  mutable std::atomic<std::size_t> consumed_{0};
+  mutable std::atomic<Chunk*> read_chunk_;
+};
+
+inline std::uint64_t trace_now_ns() {
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+// Record an event of the span of the object, in this thread's buffer.
+inline void trace(std::uint64_t id, char phase, std::string_view category,
+                  std::string_view name, std::string_view arg_name,
+                  std::string_view arg_value) {
+  ThreadBlocks<TraceBuffer>::local().add(TraceEvent{
+      trace_now_ns(), id, phase, category, name, arg_name, arg_value});
+}
+
+inline void append_trace_event(std::string& out, const TraceEvent& event,
+                               std::uint32_t tid, int pid) {
+  char number[32];
+  out.append("{\"ph\":\"").append(1, event.phase);
+  out.append("\",\"cat\":\"").append(event.category);
+  out.append("\",\"name\":\"").append(event.name);
+  out.append("\",\"id\":\"0x");
+  out.append(number,
+             std::to_chars(number, number + sizeof(number), event.id, 16).ptr);
+  out.append("\",\"pid\":");
+  out.append(number, std::to_chars(number, number + sizeof(number), pid).ptr);
+  out.append(",\"tid\":");
+  out.append(number, std::to_chars(number, number + sizeof(number), tid).ptr);
+  // In microseconds.
+  out.append(",\"ts\":");
+  out.append(number, std::to_chars(number, number + sizeof(number),
+                                   event.ts_ns / 1000)
+                         .ptr);
+  out.push_back('.');
+  const std::uint64_t fraction = event.ts_ns % 1000;
+  out.push_back(static_cast<char>('0' + fraction / 100));
+  out.push_back(static_cast<char>('0' + fraction / 10 % 10));
+  out.push_back(static_cast<char>('0' + fraction % 10));
+  out.append(",\"args\":{\"").append(event.arg_name).append("\":\"");
+  out.append(event.arg_value).append("\"}}");
+}
+
+} // namespace internal
+
+// Policy tracing each object of the protocol as a span, to write with
+// WriteChromeTrace, e.g.:
+//   PROTENC_START_WRAPPER_WITH_POLICY(RequestBuilderWrapper, RequestBuilder,
+//                                     ..., prot_enc::TracePolicy);
+// An object destroyed before its final transition ends its span with an
+// "abandoned_in" argument. The objects stored in a StatePool or an AnyState
+// keep their Slot, and their span.
+struct TracePolicy : DefaultPolicy {
+  // The id of the span, moved along with the object: the moved-from wrapper
+  // has no span.
+  struct Slot {
+    Slot() = default;
+    Slot(Slot&& other) : id(other.id) { other.id = 0; }
+    Slot& operator=(Slot&& other) {
+      id = other.id;
+      other.id = 0;
+      return *this;
+    }
+
+    std::uint64_t id = 0;
+  };
+
+  template <typename Protocol, auto State>
+  static void on_construct(Slot& slot) {
+    slot.id = internal::ThreadBlocks<internal::TraceBuffer>::local().next_id();
+    internal::trace(slot.id, 'b', protocol_name<Protocol>,
+                    protocol_name<Protocol>, "state", value_name<State>);
+  }
+
+  template <typename Protocol, auto From, auto To, auto FunctionPointer,
+            typename Call>
+  static void on_transition(Slot& slot, Call&& call) {
+    call();
+    if (slot.id == 0) return;
+    internal::trace(slot.id, 'n', protocol_name<Protocol>,
+                    value_name<FunctionPointer>, "to", value_name<To>);
+  }
+
+  template <typename Protocol, auto From, auto FunctionPointer, typename Call>
+  static decltype(auto) on_final_transition(Slot& slot,
+                                            typename Protocol::Wrapped&,
+                                            Call&& call) {
+    if constexpr (std::is_void_v<decltype(call())>) {
+      call();
+      end_span<Protocol, FunctionPointer>(slot);
+    } else {
+      decltype(auto) result = call();
+      end_span<Protocol, FunctionPointer>(slot);
+      return result;
+    }
+  }
+
+  template <typename Protocol, auto State>
+  static void on_destroy(Slot& slot) {
+    if (slot.id == 0) return;
+    internal::trace(slot.id, 'e', protocol_name<Protocol>,
+                    protocol_name<Protocol>, "abandoned_in",
+                    value_name<State>);
+  }
+
+ private:
+  template <typename Protocol>
+  static constexpr std::string_view protocol_name =
+      type_name<typename Protocol::Object>;
+
+  template <typename Protocol, auto FunctionPointer>
+  static void end_span(Slot& slot) {
+    if (slot.id == 0) return;
+    internal::trace(slot.id, 'e', protocol_name<Protocol>,
+                    protocol_name<Protocol>, "final",
+                    value_name<FunctionPointer>);
+    slot.id = 0;
+  }
+};
+
+// Write the events traced by all the threads since the last call, to the file
+// in the Chrome trace-event JSON format, and release their memory. The
+// "dropped" count is the total since the start. Returns whether all was
+// written.
+inline bool WriteChromeTrace(const char* path) {
+  std::FILE* file = std::fopen(path, "w");
+  if (file == nullptr) return false;
+  const int pid = static_cast<int>(getpid());
+  bool ok = true;
+  std::string out = "{\"traceEvents\":[\n";
+  bool first = true;
+  std::uint64_t num_dropped = 0;
+  internal::ThreadBlocks<internal::TraceBuffer>::for_each(
+      [&](const internal::TraceBuffer& buffer) {
+        num_dropped += buffer.num_dropped();
+        buffer.consume([&](const internal::TraceEvent& event) {
+          if (!first) out.append(",\n");
+          first = false;
+          internal::append_trace_event(out, event, buffer.tid(), pid);
+          // Write in pieces of about 64kB.
+          if (out.size() >= 64 * 1024) {
+            ok &= std::fwrite(out.data(), 1, out.size(), file) == out.size();
+            out.clear();
+          }
+        });
+      });
+  out.append("\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped\":\"");
+  internal::append_number(out, num_dropped);
+  out.append("\"}}\n");
+  ok &= std::fwrite(out.data(), 1, out.size(), file) == out.size();
+  return std::fclose(file) == 0 && ok;
+}
+
+} // namespace prot_enc
+
+#endif // PROTENC_TRACE_H_
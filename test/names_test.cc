@@ -0,0 +1,125 @@
+#include <array>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "protenc.h"
+#include "protenc_census.h"
+#include "protenc_metrics.h"
+#include "protenc_names.h"
+
+// Compile-time tests of the StaticNameMap perfect hash: every name is found at
+// its position, and a name out of the list is not found. The names are hashed
+// 8 characters at a time, so the names shorter than a word are the ones that
+// differ in the fewest bits.
+
+using prot_enc::StaticNameMap;
+
+template <std::size_t N>
+constexpr bool FindsAll(const std::array<std::string_view, N>& names) {
+  const StaticNameMap<N> map(names);
+  if (!map.built()) return false;
+  for (std::size_t i = 0; i < N; ++i) {
+    if (map.find(names[i]) != i) return false;
+  }
+  return map.find("NOT_A_NAME") == N && map.find("") == N;
+}
+
+// Short names, differing in a few low bits.
+static_assert(FindsAll<3>({"A", "B", "E"}));
+static_assert(FindsAll<6>({"A", "B", "C", "D", "E", "F"}));
+// Names of the same length.
+static_assert(FindsAll<4>({"AA", "AB", "BA", "BB"}));
+static_assert(FindsAll<3>({"START", "PAUSE", "CLOSE"}));
+static_assert(FindsAll<3>({"OPEN", "CLOSED", "ERROR"}));
+static_assert(FindsAll<3>({"X", "Y", "Z"}));
+static_assert(FindsAll<3>({"s1", "s2", "s3"}));
+static_assert(FindsAll<6>({"a", "b", "c", "d", "e", "f"}));
+static_assert(FindsAll<6>({"S0", "S1", "S2", "S3", "S4", "S5"}));
+// Names of 8 characters and more.
+static_assert(FindsAll<4>({"HEADERS_", "HEADERS_A", "CONTENT_LENGTH",
+                           "CONTENT_LENGTX"}));
+
+// The first N of 64 one-character names.
+constexpr std::string_view kLetters =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_";
+
+template <std::size_t N>
+constexpr bool FindsLetters() {
+  std::array<std::string_view, N> names{};
+  for (std::size_t i = 0; i < N; ++i) names[i] = kLetters.substr(i, 1);
+  return FindsAll<N>(names);
+}
+
+template <std::size_t... N>
+constexpr bool FindsAllLetters(std::index_sequence<N...>) {
+  return (FindsLetters<N + 1>() && ...);
+}
+
+static_assert(FindsAllLetters(std::make_index_sequence<kLetters.size()>()));
+
+// The names of a protocol, as used by the metrics and census policies.
+// DRAINING is not a state of the protocol.
+enum class ChannelState { OPEN, DRAINING, CLOSED, ERROR };
+
+template <ChannelState>
+class ChannelWrapper;
+
+class Channel {
+ public:
+  void close() {}
+  void fail() {}
+  int status() && { return 0; }
+
+ private:
+  Channel() = default;
+
+  template <ChannelState>
+  friend class ::ChannelWrapper;
+};
+
+using ChannelTransitions = prot_enc::Transitions<
+    prot_enc::Transition<ChannelState::OPEN, ChannelState::CLOSED,
+                         &Channel::close>,
+    prot_enc::Transition<ChannelState::OPEN, ChannelState::ERROR,
+                         &Channel::fail>>;
+using ChannelFinalTransitions = prot_enc::FinalTransitions<
+    prot_enc::FinalTransition<ChannelState::CLOSED, &Channel::status>,
+    prot_enc::FinalTransition<ChannelState::ERROR, &Channel::status>>;
+
+using ChannelPolicy =
+    prot_enc::Policies<prot_enc::MetricsPolicy, prot_enc::CensusPolicy>;
+
+PROTENC_START_WRAPPER_WITH_POLICY(
+    ChannelWrapper, Channel, ChannelState,
+    prot_enc::InitialStates<ChannelState::OPEN>, ChannelTransitions,
+    ChannelFinalTransitions, prot_enc::ValidQueries<>, ChannelPolicy);
+  PROTENC_DECLARE_TRANSITION(close);
+  PROTENC_DECLARE_TRANSITION(fail);
+  PROTENC_DECLARE_FINAL_TRANSITION(status);
+PROTENC_END_WRAPPER;
+
+using ChannelNames =
+    prot_enc::ProtocolNames<ChannelWrapper<ChannelState::OPEN>>;
+
+static_assert(ChannelNames::find_state("ERROR") == ChannelState::ERROR);
+static_assert(ChannelNames::find_state("CLOSED") == ChannelState::CLOSED);
+static_assert(!ChannelNames::find_state("CLOSE"));
+static_assert(ChannelNames::state_name(ChannelState::ERROR) == "ERROR");
+// Values that are not states of the protocol, inside and outside of the range
+// of its states.
+static_assert(ChannelNames::state_name(ChannelState::DRAINING).empty());
+static_assert(ChannelNames::state_name(static_cast<ChannelState>(-1)).empty());
+static_assert(ChannelNames::state_name(static_cast<ChannelState>(9)).empty());
+static_assert(ChannelNames::method_name(ChannelNames::find_method("fail")) ==
+              "fail");
+
+int main() {
+  const int status =
+      std::move(ChannelWrapper<ChannelState::OPEN>().fail()).status();
+  return status == 0 && prot_enc::OpenMetricsText().find(
+                            "state=\"ERROR\"") != std::string::npos
+             ? 0
+             : 1;
+}